@@ -0,0 +1,247 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BenchUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+
+namespace {
+
+constexpr double LOT_SIZE      = 20.0;
+constexpr double LOT_SPACING   = 25.0;
+constexpr double FLOOR_HEIGHT  = 3.0;
+
+using Vec3 = std::array<double, 3>;
+
+Vec3 add(const Vec3& a, const Vec3& b, double s) {
+	return { a[0] + s * b[0], a[1] + s * b[1], a[2] + s * b[2] };
+}
+
+// appends a grid of cols x rows quads spanned by the cell vectors u and v, uv sets are scaled per set
+void addQuadGrid(SyntheticGeometry& geo, const Vec3& origin, const Vec3& u, const Vec3& v, const Vec3& normal,
+                 uint32_t cols, uint32_t rows, uint32_t shapeIndex)
+{
+	const uint32_t firstPoint = static_cast<uint32_t>(geo.coords.size() / 3);
+	for (uint32_t r = 0; r <= rows; r++) {
+		for (uint32_t c = 0; c <= cols; c++) {
+			const Vec3 p = add(add(origin, u, c), v, r);
+			geo.coords.insert(geo.coords.end(), p.begin(), p.end());
+			geo.normals.insert(geo.normals.end(), normal.begin(), normal.end());
+		}
+	}
+
+	std::vector<uint32_t> firstUV(geo.uvs.size());
+	for (size_t s = 0; s < geo.uvs.size(); s++) {
+		firstUV[s] = static_cast<uint32_t>(geo.uvs[s].size() / 2);
+		const double scale = static_cast<double>(s + 1);
+		for (uint32_t r = 0; r <= rows; r++) {
+			for (uint32_t c = 0; c <= cols; c++) {
+				geo.uvs[s].push_back(scale * c / cols);
+				geo.uvs[s].push_back(scale * r / rows);
+			}
+		}
+	}
+
+	for (uint32_t r = 0; r < rows; r++) {
+		for (uint32_t c = 0; c < cols; c++) {
+			const std::array<uint32_t, 4> quad = {
+				r * (cols + 1) + c, r * (cols + 1) + c + 1, (r + 1) * (cols + 1) + c + 1, (r + 1) * (cols + 1) + c
+			};
+
+			geo.counts.push_back(4);
+			for (const uint32_t i: quad)
+				geo.indices.push_back(firstPoint + i);
+
+			for (size_t s = 0; s < geo.uvs.size(); s++) {
+				geo.uvCounts[s].push_back(4);
+				for (const uint32_t i: quad)
+					geo.uvIndices[s].push_back(firstUV[s] + i);
+			}
+
+			geo.shapeIndices.push_back(shapeIndex);
+		}
+	}
+
+	geo.meshFaceRanges.push_back(static_cast<uint32_t>(geo.counts.size()));
+}
+
+std::string formatTime(double seconds) {
+	std::ostringstream out;
+	if (seconds < 1e-3)
+		out << std::fixed << std::setprecision(3) << seconds * 1e6 << " us";
+	else
+		out << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms";
+	return out.str();
+}
+
+std::map<std::string, double> readBaseline(const std::string& file) {
+	std::map<std::string, double> medians;
+	std::ifstream in(file);
+	if (!in) {
+		std::cerr << "cannot read baseline file " << file << std::endl;
+		return medians;
+	}
+
+	std::string line;
+	std::getline(in, line); // header
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		std::string name, items, iterations, median;
+		if (std::getline(fields, name, ',') && std::getline(fields, items, ',') &&
+		    std::getline(fields, iterations, ',') && std::getline(fields, median, ','))
+			medians[name] = std::stod(median);
+	}
+	return medians;
+}
+
+} // namespace
+
+
+void BenchmarkRunner::addResult(const std::string& name, size_t items, std::vector<double>& times) {
+	std::sort(times.begin(), times.end());
+	const Result r = { name, items, times.size(), times[times.size() / 2], times.front() };
+	mResults.push_back(r);
+
+	std::cout << std::left << std::setw(48) << r.name << std::right
+	          << std::setw(8) << r.iterations << " x"
+	          << std::setw(14) << formatTime(r.median) << " (min" << std::setw(13) << formatTime(r.min) << ")"
+	          << std::setw(14) << std::fixed << std::setprecision(0) << (r.items / r.median) << " items/s" << std::endl;
+}
+
+size_t BenchmarkRunner::finish() const {
+	if (!mOptions.outFile.empty()) {
+		std::ofstream out(mOptions.outFile);
+		out << "name,items,iterations,median_s,min_s\n";
+		out << std::setprecision(9);
+		for (const auto& r: mResults)
+			out << r.name << ',' << r.items << ',' << r.iterations << ',' << r.median << ',' << r.min << '\n';
+	}
+
+	size_t regressions = 0;
+	if (!mOptions.baselineFile.empty()) {
+		const std::map<std::string, double> baseline = readBaseline(mOptions.baselineFile);
+		for (const auto& r: mResults) {
+			const auto it = baseline.find(r.name);
+			if (it == baseline.end() || it->second <= 0.0)
+				continue;
+
+			const double ratio = r.median / it->second;
+			if (ratio > 1.0 + mOptions.tolerance) {
+				std::cout << "REGRESSION " << r.name << ": " << formatTime(r.median) << " vs. baseline "
+				          << formatTime(it->second) << " (" << std::setprecision(2) << ratio << "x)" << std::endl;
+				regressions++;
+			}
+		}
+	}
+	return regressions;
+}
+
+void consume(size_t value) {
+	static volatile size_t sink = 0;
+	sink = sink + value;
+}
+
+SyntheticGeometry createLotGrid(uint32_t lotsPerSide, uint32_t uvSets) {
+	SyntheticGeometry geo(uvSets);
+	for (uint32_t y = 0; y < lotsPerSide; y++) {
+		for (uint32_t x = 0; x < lotsPerSide; x++) {
+			const Vec3 origin = { x * LOT_SPACING, 0.0, y * LOT_SPACING };
+			addQuadGrid(geo, origin, { LOT_SIZE, 0.0, 0.0 }, { 0.0, 0.0, LOT_SIZE }, { 0.0, 1.0, 0.0 }, 1, 1, geo.shapeCount++);
+		}
+	}
+	return geo;
+}
+
+SyntheticGeometry createFacades(uint32_t buildings, uint32_t floors, uint32_t tilesPerFloor, uint32_t uvSets) {
+	SyntheticGeometry geo(uvSets);
+	const double tileWidth = LOT_SIZE / tilesPerFloor;
+	const uint32_t buildingsPerSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(buildings))));
+	const Vec3 up = { 0.0, FLOOR_HEIGHT, 0.0 };
+
+	for (uint32_t b = 0; b < buildings; b++) {
+		const double x = (b % buildingsPerSide) * LOT_SPACING;
+		const double z = (b / buildingsPerSide) * LOT_SPACING;
+
+		// counter-clockwise around the footprint, facade normals point outwards
+		addQuadGrid(geo, { x, 0.0, z + LOT_SIZE }, { tileWidth, 0.0, 0.0 }, up, { 0.0, 0.0, 1.0 }, tilesPerFloor, floors, geo.shapeCount);
+		addQuadGrid(geo, { x + LOT_SIZE, 0.0, z + LOT_SIZE }, { 0.0, 0.0, -tileWidth }, up, { 1.0, 0.0, 0.0 }, tilesPerFloor, floors, geo.shapeCount);
+		addQuadGrid(geo, { x + LOT_SIZE, 0.0, z }, { -tileWidth, 0.0, 0.0 }, up, { 0.0, 0.0, -1.0 }, tilesPerFloor, floors, geo.shapeCount);
+		addQuadGrid(geo, { x, 0.0, z }, { 0.0, 0.0, tileWidth }, up, { -1.0, 0.0, 0.0 }, tilesPerFloor, floors, geo.shapeCount);
+		geo.shapeCount++;
+	}
+	return geo;
+}
+
+std::vector<SyntheticGeometry> splitShapes(const SyntheticGeometry& geo) {
+	const uint32_t uvSets = static_cast<uint32_t>(geo.uvs.size());
+	std::vector<SyntheticGeometry> shapes(geo.shapeCount, SyntheticGeometry(uvSets));
+
+	// the generators append points and uvs per mesh, i.e. the first index of a mesh is its smallest index
+	std::vector<uint32_t> indexOffsets(uvSets + 1, 0);
+	size_t fi = 0;
+	for (size_t mi = 0; mi + 1 < geo.meshFaceRanges.size(); mi++) {
+		const uint32_t faceEnd = geo.meshFaceRanges[mi + 1];
+		if (fi == faceEnd)
+			continue;
+
+		SyntheticGeometry& shape = shapes[geo.shapeIndices[fi]];
+		const uint32_t pointBase = geo.indices[indexOffsets[0]];
+		const uint32_t shapePointBase = static_cast<uint32_t>(shape.coords.size() / 3);
+		uint32_t pointEnd = pointBase;
+
+		std::vector<uint32_t> uvBase(uvSets), shapeUVBase(uvSets), uvEnd(uvSets);
+		for (uint32_t s = 0; s < uvSets; s++) {
+			uvBase[s] = uvEnd[s] = geo.uvIndices[s][indexOffsets[s + 1]];
+			shapeUVBase[s] = static_cast<uint32_t>(shape.uvs[s].size() / 2);
+		}
+
+		for (; fi < faceEnd; fi++) {
+			const uint32_t count = geo.counts[fi];
+			shape.counts.push_back(count);
+			shape.shapeIndices.push_back(0);
+			for (uint32_t i = 0; i < count; i++) {
+				const uint32_t pi = geo.indices[indexOffsets[0]++];
+				shape.indices.push_back(shapePointBase + pi - pointBase);
+				pointEnd = std::max(pointEnd, pi + 1);
+			}
+			for (uint32_t s = 0; s < uvSets; s++) {
+				shape.uvCounts[s].push_back(geo.uvCounts[s][fi]);
+				for (uint32_t i = 0; i < geo.uvCounts[s][fi]; i++) {
+					const uint32_t ui = geo.uvIndices[s][indexOffsets[s + 1]++];
+					shape.uvIndices[s].push_back(shapeUVBase[s] + ui - uvBase[s]);
+					uvEnd[s] = std::max(uvEnd[s], ui + 1);
+				}
+			}
+		}
+
+		shape.coords.insert(shape.coords.end(), geo.coords.begin() + 3 * pointBase, geo.coords.begin() + 3 * pointEnd);
+		shape.normals.insert(shape.normals.end(), geo.normals.begin() + 3 * pointBase, geo.normals.begin() + 3 * pointEnd);
+		for (uint32_t s = 0; s < uvSets; s++)
+			shape.uvs[s].insert(shape.uvs[s].end(), geo.uvs[s].begin() + 2 * uvBase[s], geo.uvs[s].begin() + 2 * uvEnd[s]);
+		shape.meshFaceRanges.push_back(static_cast<uint32_t>(shape.counts.size()));
+		shape.shapeCount = 1;
+	}
+	return shapes;
+}
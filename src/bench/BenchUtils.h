@@ -0,0 +1,126 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * minimal benchmark runner: each benchmark body is called until the minimum run time and iteration count
+ * are reached, the median time per call is reported. results can be written to a CSV file and compared
+ * against the CSV file of an earlier run to detect regressions.
+ */
+class BenchmarkRunner {
+public:
+	struct Options {
+		std::string filter;               // only run benchmarks with names containing this string
+		double      minTime       = 0.5;  // seconds per benchmark
+		size_t      minIterations = 5;
+		std::string outFile;              // optional CSV output
+		std::string baselineFile;         // optional CSV output of an earlier run
+		double      tolerance     = 0.1;  // accepted slowdown of the median against the baseline
+	};
+
+	explicit BenchmarkRunner(const Options& options) : mOptions(options) { }
+
+	bool isSelected(const std::string& name) const {
+		return name.find(mOptions.filter) != std::string::npos;
+	}
+
+	// calls setup (not timed) before each call of body, body processes 'items' elements (e.g. faces or strings)
+	template<typename S, typename B>
+	void run(const std::string& name, size_t items, S&& setup, B&& body) {
+		if (!isSelected(name))
+			return;
+
+		std::vector<double> times;
+		const auto start = Clock::now();
+		while (times.size() < mOptions.minIterations || getSeconds(start) < mOptions.minTime) {
+			setup();
+			const auto bodyStart = Clock::now();
+			body();
+			times.push_back(getSeconds(bodyStart));
+		}
+		addResult(name, items, times);
+	}
+
+	template<typename B>
+	void run(const std::string& name, size_t items, B&& body) {
+		run(name, items, [](){}, std::forward<B>(body));
+	}
+
+	// writes the CSV file and returns the number of benchmarks which are slower than their baseline
+	size_t finish() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Result {
+		std::string name;
+		size_t      items;
+		size_t      iterations;
+		double      median; // seconds
+		double      min;    // seconds
+	};
+
+	static double getSeconds(const Clock::time_point& start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	void addResult(const std::string& name, size_t items, std::vector<double>& times);
+
+	const Options       mOptions;
+	std::vector<Result> mResults;
+};
+
+// keeps the compiler from optimizing away benchmarked computations
+void consume(size_t value);
+
+
+/**
+ * synthetic geometry in the layout of the houdini encoder output (see detail::SerializedGeometry),
+ * each face is assigned to a shape (lot or building)
+ */
+struct SyntheticGeometry {
+	std::vector<double>                coords;
+	std::vector<double>                normals; // uses same indexing as coords
+	std::vector<uint32_t>              counts;
+	std::vector<uint32_t>              indices;
+
+	std::vector<std::vector<double>>   uvs;
+	std::vector<std::vector<uint32_t>> uvCounts;
+	std::vector<std::vector<uint32_t>> uvIndices;
+
+	std::vector<uint32_t>              shapeIndices;  // per face
+	std::vector<uint32_t>              meshFaceRanges; // faces of mesh i: [meshFaceRanges[i], meshFaceRanges[i+1])
+	uint32_t                           shapeCount = 0;
+
+	explicit SyntheticGeometry(uint32_t uvSets) : uvs(uvSets), uvCounts(uvSets), uvIndices(uvSets), meshFaceRanges(1, 0) { }
+};
+
+// square grid of lots, one quad per lot and mesh
+SyntheticGeometry createLotGrid(uint32_t lotsPerSide, uint32_t uvSets);
+
+// box buildings with four facades (one mesh each) split into floors x tiles quads
+SyntheticGeometry createFacades(uint32_t buildings, uint32_t floors, uint32_t tilesPerFloor, uint32_t uvSets);
+
+// splits the geometry into one geometry per shape with shape local indices (shapes are contiguous)
+std::vector<SyntheticGeometry> splitShapes(const SyntheticGeometry& geo);
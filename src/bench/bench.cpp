@@ -0,0 +1,392 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BenchUtils.h"
+
+#include "../palladio/PRTContext.h"
+#include "../palladio/Utils.h"
+#include "../palladio/ModelConverter.h"
+#include "../palladio/AttributeConversion.h"
+#include "../palladio/PrimitiveClassifier.h"
+#include "../palladio/PrimitivePartition.h"
+#include "../palladio/ShapeConverter.h"
+#include "../palladio/ShapeData.h"
+#include "../palladio/LRUCache.h"
+#include "../codec/encoder/HoudiniEncoder.h"
+
+#include "prt/AttributeMap.h"
+#include "prtx/Geometry.h"
+#include "prtx/Mesh.h"
+
+#include "GU/GU_Detail.h"
+#include "UT/UT_ParallelUtil.h"
+
+#include "../palladio/BoostRedirect.h"
+#include PLD_BOOST_INCLUDE(/filesystem/path.hpp)
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+
+namespace {
+
+// synthetic city sizes
+constexpr uint32_t LOTS_PER_SIDE   = 100; // 10k lots
+constexpr uint32_t BUILDINGS       = 400;
+constexpr uint32_t FLOORS          = 20;
+constexpr uint32_t TILES_PER_FLOOR = 10;  // 320k facade faces
+constexpr uint32_t UV_BUILDINGS    = 100;
+constexpr uint32_t UV_SETS         = 6;   // supported by all PRT versions
+
+constexpr size_t NUM_ATTRIBUTE_MAPS = 16;
+constexpr size_t NUM_KEYS           = 10000;
+constexpr size_t CACHE_CAPACITY     = 16384;
+
+const UT_String CLASSIFIER_NAME = "shapeIndex";
+
+struct Scenario {
+	std::string                    name;
+	SyntheticGeometry              city;
+	std::vector<SyntheticGeometry> shapes;
+
+	Scenario(const std::string& n, SyntheticGeometry&& g) : name(n), city(std::move(g)), shapes(splitShapes(city)) { }
+
+	size_t getFaceCount() const { return city.counts.size(); }
+};
+
+// pointer/size arrays of the uv sets as passed to HoudiniCallbacks::add
+struct UVArrays {
+	std::vector<const double*>   uvs;
+	std::vector<size_t>          uvsSizes;
+	std::vector<const uint32_t*> uvCounts;
+	std::vector<size_t>          uvCountsSizes;
+	std::vector<const uint32_t*> uvIndices;
+	std::vector<size_t>          uvIndicesSizes;
+
+	explicit UVArrays(const SyntheticGeometry& geo) {
+		for (size_t s = 0; s < geo.uvs.size(); s++) {
+			uvs.push_back(geo.uvs[s].data());
+			uvsSizes.push_back(geo.uvs[s].size());
+			uvCounts.push_back(geo.uvCounts[s].data());
+			uvCountsSizes.push_back(geo.uvCounts[s].size());
+			uvIndices.push_back(geo.uvIndices[s].data());
+			uvIndicesSizes.push_back(geo.uvIndices[s].size());
+		}
+	}
+};
+
+GA_Offset createPrimitives(GU_Detail* gdp, const SyntheticGeometry& geo, const UVArrays& uva) {
+	return ModelConversion::createPrimitives(gdp, GroupCreation::NONE, L"shape",
+	                                         geo.coords.data(), geo.coords.size(),
+	                                         geo.normals.data(), geo.normals.size(),
+	                                         geo.counts.data(), geo.counts.size(),
+	                                         geo.indices.data(), geo.indices.size(),
+	                                         uva.uvs.data(), uva.uvsSizes.data(),
+	                                         uva.uvCounts.data(), uva.uvCountsSizes.data(),
+	                                         uva.uvIndices.data(), uva.uvIndicesSizes.data(),
+	                                         static_cast<uint32_t>(geo.uvs.size()));
+}
+
+// one leaf geometry per mesh, i.e. per lot or facade
+struct EncoderInput {
+	prtx::GeometryPtrVector              geometries;
+	std::vector<prtx::MaterialPtrVector> materials;
+};
+
+EncoderInput createEncoderInput(const SyntheticGeometry& shape) {
+	// split the shape into its meshes to get mesh local indices
+	SyntheticGeometry meshShapes(shape);
+	meshShapes.shapeCount = static_cast<uint32_t>(shape.meshFaceRanges.size() - 1);
+	for (uint32_t mi = 0; mi < meshShapes.shapeCount; mi++)
+		std::fill(meshShapes.shapeIndices.begin() + shape.meshFaceRanges[mi], meshShapes.shapeIndices.begin() + shape.meshFaceRanges[mi + 1], mi);
+
+	EncoderInput input;
+	for (const auto& m: splitShapes(meshShapes)) {
+		prtx::MeshBuilder mb;
+		mb.addVertexCoords(m.coords);
+		mb.addNormalCoords(m.normals);
+		for (uint32_t s = 0; s < m.uvs.size(); s++)
+			mb.addUVCoords(s, m.uvs[s]);
+
+		size_t indexOffset = 0;
+		std::vector<size_t> uvIndexOffsets(m.uvs.size(), 0);
+		for (uint32_t fi = 0; fi < m.counts.size(); fi++) {
+			const uint32_t count = m.counts[fi];
+			const prtx::IndexVector vtxIdx(m.indices.begin() + indexOffset, m.indices.begin() + indexOffset + count);
+			indexOffset += count;
+
+			const uint32_t faceIdx = mb.addFace();
+			mb.setFaceVertexIndices(faceIdx, vtxIdx);
+			mb.setFaceNormalIndices(faceIdx, vtxIdx);
+			for (uint32_t s = 0; s < m.uvs.size(); s++) {
+				const auto uvBegin = m.uvIndices[s].begin() + uvIndexOffsets[s];
+				const uint32_t uvCount = m.uvCounts[s][fi];
+				mb.setFaceUVIndices(faceIdx, s, prtx::IndexVector(uvBegin, uvBegin + uvCount));
+				uvIndexOffsets[s] += uvCount;
+			}
+		}
+
+		const auto mesh = mb.createShared();
+		prtx::GeometryBuilder gb;
+		gb.addMesh(mesh);
+		input.geometries.push_back(gb.createShared());
+		input.materials.push_back(mesh->getMaterials());
+	}
+	return input;
+}
+
+// material/report like attribute maps with a mix of scalar, string and array values
+AttributeMapVector createAttributeMaps() {
+	AttributeMapVector maps;
+	AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+	for (size_t i = 0; i < NUM_ATTRIBUTE_MAPS; i++) {
+		const std::wstring suffix = std::to_wstring(i);
+		const double color[3] = { 0.1 * (i % 10), 0.5, 1.0 };
+		amb->setFloatArray(L"diffuseColor", color, 3);
+		amb->setFloatArray(L"specularColor", color, 3);
+		amb->setFloat(L"opacity", 1.0);
+		amb->setFloat(L"shininess", 0.5 * i);
+		amb->setString(L"name", (L"material_" + suffix).c_str());
+		amb->setString(L"colormap", (L"assets/facades/facade_" + suffix + L".jpg").c_str());
+		amb->setString(L"bumpmap", (L"assets/facades/facade_" + suffix + L"_bump.jpg").c_str());
+		amb->setInt(L"Default$floors", static_cast<int32_t>(i));
+		amb->setBool(L"Default$hasBalconies", (i % 2) == 0);
+		const wchar_t* tags[2] = { L"residential", L"facade" };
+		amb->setStringArray(L"Default$tags", tags, 2);
+		maps.emplace_back(amb->createAttributeMapAndReset());
+	}
+	return maps;
+}
+
+// city geometry with an int primitive classifier attribute (one initial shape per lot or building)
+void createInputDetail(GU_Detail* gdp, const SyntheticGeometry& city) {
+	const GA_Offset primStart = createPrimitives(gdp, city, UVArrays(city));
+	GA_RWHandleI clsH(gdp->addIntTuple(GA_ATTRIB_PRIMITIVE, CLASSIFIER_NAME, 1));
+	for (size_t fi = 0; fi < city.shapeIndices.size(); fi++)
+		clsH.set(primStart + static_cast<GA_Offset>(fi), static_cast<int32>(city.shapeIndices[fi]));
+}
+
+void benchmarkConversion(BenchmarkRunner& runner, const Scenario& scenario, const PRTContextUPtr& prtCtx) {
+	const size_t faceCount = scenario.getFaceCount();
+
+	// -- encoder: leaf geometries of an initial shape into the buffers passed to HoudiniCallbacks::add
+	if (runner.isSelected("serializeGeometry/" + scenario.name)) {
+		std::vector<EncoderInput> inputs;
+		for (const auto& shape: scenario.shapes)
+			inputs.push_back(createEncoderInput(shape));
+
+		runner.run("serializeGeometry/" + scenario.name, faceCount, [&inputs]() {
+			for (const auto& input: inputs) {
+				const detail::SerializedGeometry sg = detail::serializeGeometry(input.geometries, input.materials);
+				consume(sg.indices.size());
+			}
+		});
+	}
+
+	// -- houdini callbacks: initial shape geometry into houdini primitives
+	if (runner.isSelected("createPrimitives/" + scenario.name)) {
+		std::vector<UVArrays> uvArrays;
+		for (const auto& shape: scenario.shapes)
+			uvArrays.emplace_back(shape);
+
+		GU_Detail gdp;
+		runner.run("createPrimitives/" + scenario.name, faceCount, [&gdp]() { gdp.clearAndDestroy(); }, [&]() {
+			for (size_t si = 0; si < scenario.shapes.size(); si++)
+				consume(static_cast<size_t>(createPrimitives(&gdp, scenario.shapes[si], uvArrays[si])));
+		});
+	}
+
+	// -- houdini callbacks: material/report attribute maps into primitive attributes (per face range)
+	if (runner.isSelected("AttributeConversion/tuples/" + scenario.name) || runner.isSelected("AttributeConversion/arrays/" + scenario.name)) {
+		GU_Detail gdp;
+		GA_Offset primStart = createPrimitives(&gdp, scenario.city, UVArrays(scenario.city));
+		const GA_IndexMap& primIndexMap = gdp.getIndexMap(GA_ATTRIB_PRIMITIVE);
+		const AttributeMapVector attrMaps = createAttributeMaps();
+		const SyntheticGeometry& city = scenario.city;
+
+		const auto writeAttributes = [&](const AttributeConversion::StorageOptions& storageOptions) {
+			AttributeConversion::HandleMap handleMap;
+			for (size_t mi = 0; mi + 1 < city.meshFaceRanges.size(); mi++) {
+				const uint32_t faceStart = city.meshFaceRanges[mi];
+				if (mi > 0 && city.shapeIndices[faceStart] != city.shapeIndices[faceStart - 1])
+					handleMap.clear(); // one handle map per initial shape, as in ModelConverter::add
+
+				const prt::AttributeMap* attrMap = attrMaps[mi % attrMaps.size()].get();
+				const GA_Size rangeSize = city.meshFaceRanges[mi + 1] - faceStart;
+				AttributeConversion::extractAttributeNames(handleMap, attrMap);
+				AttributeConversion::createAttributeHandles(&gdp, handleMap, storageOptions);
+				AttributeConversion::setAttributeValues(handleMap, attrMap, primIndexMap, primStart + faceStart, rangeSize);
+			}
+		};
+
+		AttributeConversion::StorageOptions tupleStorage;
+		runner.run("AttributeConversion/tuples/" + scenario.name, faceCount, [&]() { writeAttributes(tupleStorage); });
+
+		AttributeConversion::StorageOptions arrayStorage;
+		arrayStorage.floatPrecision = AttributeConversion::FloatPrecision::DOUBLE;
+		arrayStorage.arrayStorage = AttributeConversion::ArrayStorage::ARRAY;
+		gdp.clearAndDestroy();
+		primStart = createPrimitives(&gdp, city, UVArrays(city));
+		runner.run("AttributeConversion/arrays/" + scenario.name, faceCount, [&]() { writeAttributes(arrayStorage); });
+	}
+
+	// -- generate node input: partitioning of primitives and conversion into initial shapes
+	if (runner.isSelected("PrimitivePartition/" + scenario.name) || runner.isSelected("ShapeConverter::get/" + scenario.name)) {
+		GU_Detail gdp;
+		createInputDetail(&gdp, scenario.city);
+
+		PrimitiveClassifier primCls;
+		primCls.name.harden(CLASSIFIER_NAME);
+
+		runner.run("PrimitivePartition/" + scenario.name, faceCount, [&]() {
+			const PrimitivePartition partition(&gdp, primCls);
+			consume(partition.get().size());
+		});
+
+		ShapeConverter shapeConverter;
+		std::unique_ptr<ShapeData> shapeData;
+		runner.run("ShapeConverter::get/" + scenario.name, faceCount,
+		           [&shapeData]() { shapeData.reset(new ShapeData(GroupCreation::NONE, L"shape")); },
+		           [&]() {
+			           shapeConverter.get(&gdp, primCls, *shapeData, prtCtx);
+			           consume(shapeData->getInitialShapeBuilders().size());
+		           });
+	}
+}
+
+// rule attribute like names
+std::vector<std::wstring> createKeys(const std::wstring& prefix) {
+	std::vector<std::wstring> keys;
+	keys.reserve(NUM_KEYS);
+	for (size_t i = 0; i < NUM_KEYS; i++)
+		keys.push_back(prefix + L"attribute_" + std::to_wstring(i));
+	return keys;
+}
+
+void benchmarkCaches(BenchmarkRunner& runner) {
+	const std::vector<std::wstring> keys = createKeys(L"Default$");
+
+	LRUCache<int> hitCache(CACHE_CAPACITY);
+	for (size_t i = 0; i < keys.size(); i++)
+		hitCache.insert(keys[i], static_cast<int>(i));
+	runner.run("LRUCache/hits", keys.size(), [&]() {
+		for (const auto& k: keys)
+			consume(static_cast<size_t>(*hitCache.get(k.c_str(), k.size())));
+	});
+
+	LRUCache<int> evictCache(NUM_KEYS / 10);
+	runner.run("LRUCache/evictions", keys.size(), [&]() {
+		for (size_t i = 0; i < keys.size(); i++)
+			consume(static_cast<size_t>(evictCache.insert(keys[i].c_str(), keys[i].size(), static_cast<int>(i))));
+	});
+
+	ShardedLRUCache<int> shardedCache(CACHE_CAPACITY);
+	for (size_t i = 0; i < keys.size(); i++)
+		shardedCache.insert(keys[i].c_str(), keys[i].size(), static_cast<int>(i));
+	runner.run("ShardedLRUCache/parallel-hits", keys.size(), [&]() {
+		UTparallelForEachNumber(keys.size(), [&](const UT_BlockedRange<size_t>& r) {
+			int v = 0;
+			for (size_t i = r.begin(); i < r.end(); ++i)
+				shardedCache.get(keys[i].c_str(), keys[i].size(), v);
+			consume(static_cast<size_t>(v));
+		});
+	});
+}
+
+void benchmarkStrings(BenchmarkRunner& runner) {
+	const std::vector<std::wstring> asciiKeys = createKeys(L"Default$");
+	const std::vector<std::wstring> nonAsciiKeys = createKeys(L"Default$\u00e4\u00f6\u00fc_");
+
+	std::vector<std::string> narrowKeys;
+	for (const auto& k: asciiKeys)
+		narrowKeys.push_back(toOSNarrowFromUTF16(k));
+
+	std::string narrow;
+	runner.run("toOSNarrowFromUTF16/ascii", asciiKeys.size(), [&]() {
+		for (const auto& k: asciiKeys) {
+			toOSNarrowFromUTF16(k.c_str(), k.size(), narrow);
+			consume(narrow.size());
+		}
+	});
+	runner.run("toOSNarrowFromUTF16/non-ascii", nonAsciiKeys.size(), [&]() {
+		for (const auto& k: nonAsciiKeys) {
+			toOSNarrowFromUTF16(k.c_str(), k.size(), narrow);
+			consume(narrow.size());
+		}
+	});
+
+	std::wstring wide;
+	runner.run("toUTF16FromOSNarrow/ascii", narrowKeys.size(), [&]() {
+		for (const auto& k: narrowKeys) {
+			toUTF16FromOSNarrow(k.c_str(), k.size(), wide);
+			consume(wide.size());
+		}
+	});
+
+	runner.run("NameConversion::toPrimAttr", asciiKeys.size(), [&]() {
+		for (const auto& k: asciiKeys)
+			consume(NameConversion::toPrimAttr(k).length());
+	});
+}
+
+void printUsage() {
+	std::cout << "usage: palladio_bench [filter] [--min-time <seconds>] [--out <csv file>]"
+	             " [--baseline <csv file>] [--tolerance <fraction>]" << std::endl;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+	BenchmarkRunner::Options options;
+	for (int i = 1; i < argc; i++) {
+		const bool hasValue = (i + 1 < argc);
+		if (std::strcmp(argv[i], "--min-time") == 0 && hasValue)
+			options.minTime = std::atof(argv[++i]);
+		else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+			options.outFile = argv[++i];
+		else if (std::strcmp(argv[i], "--baseline") == 0 && hasValue)
+			options.baselineFile = argv[++i];
+		else if (std::strcmp(argv[i], "--tolerance") == 0 && hasValue)
+			options.tolerance = std::atof(argv[++i]);
+		else if (argv[i][0] != '-')
+			options.filter = argv[i];
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	const std::vector<PLD_BOOST_NS::filesystem::path> addExtDirs = {
+		HOUDINI_CODEC_PATH // set to absolute path to houdini encoder lib via cmake
+	};
+	const PRTContextUPtr prtCtx(new PRTContext(addExtDirs));
+
+	BenchmarkRunner runner(options);
+
+	benchmarkConversion(runner, Scenario("lots", createLotGrid(LOTS_PER_SIDE, 1)), prtCtx);
+	benchmarkConversion(runner, Scenario("facades", createFacades(BUILDINGS, FLOORS, TILES_PER_FLOOR, 1)), prtCtx);
+	benchmarkConversion(runner, Scenario("uvsets", createFacades(UV_BUILDINGS, FLOORS, TILES_PER_FLOOR, UV_SETS)), prtCtx);
+
+	benchmarkCaches(runner);
+	benchmarkStrings(runner);
+
+	return (runner.finish() > 0) ? 1 : 0;
+}
@@ -22,6 +22,7 @@ constexpr const wchar_t* ENCODER_ID_HOUDINI = L"HoudiniEncoder";
 constexpr const wchar_t* EO_EMIT_ATTRIBUTES = L"emitAttributes";
 constexpr const wchar_t* EO_EMIT_MATERIALS  = L"emitMaterials";
 constexpr const wchar_t* EO_EMIT_REPORTS    = L"emitReports";
+constexpr const wchar_t* EO_EMIT_STATISTICS = L"emitStatistics";
 
 
 class HoudiniCallbacks : public prt::Callbacks {
@@ -68,4 +69,15 @@ public:
 			const prt::AttributeMap** reports,
 			const int32_t* shapeIDs
 	) = 0;
+
+	/**
+	 * only called if the encoder option EO_EMIT_STATISTICS is set, right before add() for the same initial shape
+	 * @param isIndex initial shape index
+	 * @param leafShapeCount number of leaf shapes
+	 * @param faceCount number of faces passed to add()
+	 * @param geometryBytes size of the geometry buffers passed to add() (coordinates, normals, indices, uvs)
+	 * @param encodeTime seconds spent in the encoder for this initial shape (leaf shape iteration and geometry preparation)
+	 */
+	virtual void addStatistics(size_t isIndex, uint32_t leafShapeCount, uint32_t faceCount, size_t geometryBytes,
+	                           double encodeTime) = 0;
 };
@@ -40,6 +40,7 @@
 #include <algorithm>
 #include <set>
 #include <memory>
+#include <chrono>
 
 
 namespace {
@@ -49,6 +50,16 @@ constexpr bool           DBG                = false;
 constexpr const wchar_t* ENC_NAME           = L"SideFX(tm) Houdini(tm) Encoder";
 constexpr const wchar_t* ENC_DESCRIPTION    = L"Encodes geometry into the Houdini format.";
 
+template<typename T>
+size_t getByteSize(const std::vector<T>& v) {
+	return v.size() * sizeof(T);
+}
+
+template<typename T>
+size_t getByteSize(const std::vector<std::vector<T>>& vv) {
+	return std::accumulate(vv.begin(), vv.end(), size_t(0), [](size_t s, const std::vector<T>& v) { return s + getByteSize(v); });
+}
+
 const prtx::EncodePreparator::PreparationFlags PREP_FLAGS = prtx::EncodePreparator::PreparationFlags()
 	.instancing(false)
 	.mergeByMaterial(false)
@@ -457,6 +468,16 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 } // namespace detail
 
 
+namespace detail {
+
+struct EncodeStatistics {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint32_t                              leafShapeCount = 0;
+};
+
+} // namespace detail
+
+
 HoudiniEncoder::HoudiniEncoder(const std::wstring& id, const prt::AttributeMap* options, prt::Callbacks* callbacks)
 : prtx::GeometryEncoder(id, options, callbacks)
 {  }
@@ -475,6 +496,10 @@ void HoudiniEncoder::encode(prtx::GenerateContext& context, size_t initialShapeI
 
 	const bool emitAttrs = getOptions()->getBool(EO_EMIT_ATTRIBUTES);
 
+	std::unique_ptr<detail::EncodeStatistics> statistics;
+	if (getOptions()->getBool(EO_EMIT_STATISTICS))
+		statistics.reset(new detail::EncodeStatistics());
+
 	prtx::DefaultNamePreparator        namePrep;
 	prtx::NamePreparator::NamespacePtr nsMesh     = namePrep.newNamespace();
 	prtx::NamePreparator::NamespacePtr nsMaterial = namePrep.newNamespace();
@@ -491,16 +516,21 @@ void HoudiniEncoder::encode(prtx::GenerateContext& context, size_t initialShapeI
 		// get final values of generic attributes
 		if (emitAttrs)
 			forwardGenericAttributes(cb, initialShapeIndex, initialShape, shape);
+
+		if (statistics)
+			statistics->leafShapeCount++;
 	}
 
 	prtx::EncodePreparator::InstanceVector instances;
 	encPrep->fetchFinalizedInstances(instances, PREP_FLAGS);
-	convertGeometry(initialShape, instances, cb);
+	convertGeometry(initialShapeIndex, initialShape, instances, cb, statistics.get());
 }
 
-void HoudiniEncoder::convertGeometry(const prtx::InitialShape& initialShape,
+void HoudiniEncoder::convertGeometry(size_t initialShapeIndex,
+                                     const prtx::InitialShape& initialShape,
                                      const prtx::EncodePreparator::InstanceVector& instances,
-                                     HoudiniCallbacks* cb)
+                                     HoudiniCallbacks* cb,
+                                     const detail::EncodeStatistics* statistics)
 {
 	const bool emitMaterials = getOptions()->getBool(EO_EMIT_MATERIALS);
 	const bool emitReports = getOptions()->getBool(EO_EMIT_REPORTS);
@@ -581,6 +611,14 @@ void HoudiniEncoder::convertGeometry(const prtx::InitialShape& initialShape,
 	assert(sg.uvs.size() == puvCounts.first.size());
 	assert(sg.uvs.size() == puvCounts.second.size());
 
+	if (statistics != nullptr) {
+		const size_t geometryBytes = getByteSize(sg.coords) + getByteSize(sg.normals) + getByteSize(sg.counts) +
+		                             getByteSize(sg.indices) + getByteSize(sg.uvs) + getByteSize(sg.uvCounts) +
+		                             getByteSize(sg.uvIndices);
+		const double encodeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - statistics->start).count();
+		cb->addStatistics(initialShapeIndex, statistics->leafShapeCount, faceCount, geometryBytes, encodeTime);
+	}
+
 	cb->add(initialShape.getName(),
 	        sg.coords.data(), sg.coords.size(),
 			sg.normals.data(), sg.normals.size(),
@@ -616,6 +654,7 @@ HoudiniEncoderFactory* HoudiniEncoderFactory::createInstance() {
 	amb->setBool(EO_EMIT_ATTRIBUTES, prtx::PRTX_FALSE);
 	amb->setBool(EO_EMIT_MATERIALS,  prtx::PRTX_FALSE);
 	amb->setBool(EO_EMIT_REPORTS,    prtx::PRTX_FALSE);
+	amb->setBool(EO_EMIT_STATISTICS, prtx::PRTX_FALSE);
 	encoderInfoBuilder.setDefaultOptions(amb->createAttributeMap());
 
 	return new HoudiniEncoderFactory(encoderInfoBuilder.create());
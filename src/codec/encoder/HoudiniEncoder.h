@@ -39,6 +39,8 @@ class HoudiniCallbacks;
 
 namespace detail {
 
+struct EncodeStatistics;
+
 struct SerializedGeometry {
 	prtx::DoubleVector              coords;
 	prtx::DoubleVector              normals; // uses same indexing as coords
@@ -76,9 +78,11 @@ public:
 	void finish(prtx::GenerateContext& context) override;
 
 private:
-	void convertGeometry(const prtx::InitialShape& initialShape,
+	void convertGeometry(size_t initialShapeIndex,
+	                     const prtx::InitialShape& initialShape,
 	                     const prtx::EncodePreparator::InstanceVector& instances,
-	                     HoudiniCallbacks* callbacks);
+	                     HoudiniCallbacks* callbacks,
+	                     const detail::EncodeStatistics* statistics); // optional
 };
 
 
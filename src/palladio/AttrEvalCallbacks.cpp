@@ -20,22 +20,7 @@
 
 namespace {
 
-constexpr bool           DBG                   = false;
-constexpr const wchar_t* CGA_ANNOTATION_HIDDEN = L"@Hidden";
-
-bool isHiddenAttribute(const RuleFileInfoUPtr& ruleFileInfo, const wchar_t* key) {
-	for (size_t ai = 0, numAttrs = ruleFileInfo->getNumAttributes(); ai < numAttrs; ai++) {
-		const auto attr = ruleFileInfo->getAttribute(ai);
-		if (std::wcscmp(key, attr->getName()) == 0) {
-			for (size_t k = 0, numAnns = attr->getNumAnnotations(); k < numAnns; k++) {
-				if (std::wcscmp(attr->getAnnotation(k)->getName(), CGA_ANNOTATION_HIDDEN) == 0)
-					return true;
-			}
-			return false;
-		}
-	}
-	return false;
-}
+constexpr bool DBG = false;
 
 } // namespace
 
@@ -71,21 +56,24 @@ prt::Status AttrEvalCallbacks::cgaReportString(size_t isIndex, int32_t shapeID,
 
 prt::Status AttrEvalCallbacks::attrBool(size_t isIndex, int32_t shapeID, const wchar_t* key, bool value) {
 	if (DBG) LOG_DBG << "attrBool: isIndex = " << isIndex << ", key = " << key << " = " << value;
-	if (mRuleFileInfo[isIndex] && !isHiddenAttribute(mRuleFileInfo[isIndex], key))
-		mAMBS[isIndex]->setBool(key, value);
+	const size_t idx = mIsIndices[mIsIndexOffset + isIndex];
+	if (isVisible(idx, key))
+		mAMBS[idx]->setBool(key, value);
 	return prt::STATUS_OK;
 }
 
 prt::Status AttrEvalCallbacks::attrFloat(size_t isIndex, int32_t shapeID, const wchar_t* key, double value) {
 	if (DBG) LOG_DBG << "attrFloat: isIndex = " << isIndex << ", key = " << key << " = " << value;
-	if (mRuleFileInfo[isIndex] && !isHiddenAttribute(mRuleFileInfo[isIndex], key))
-		mAMBS[isIndex]->setFloat(key, value);
+	const size_t idx = mIsIndices[mIsIndexOffset + isIndex];
+	if (isVisible(idx, key))
+		mAMBS[idx]->setFloat(key, value);
 	return prt::STATUS_OK;
 }
 
 prt::Status AttrEvalCallbacks::attrString(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* value) {
 	if (DBG) LOG_DBG << "attrString: isIndex = " << isIndex << ", key = " << key << " = " << value;
-	if (mRuleFileInfo[isIndex] && !isHiddenAttribute(mRuleFileInfo[isIndex], key))
-		mAMBS[isIndex]->setString(key, value);
+	const size_t idx = mIsIndices[mIsIndexOffset + isIndex];
+	if (isVisible(idx, key))
+		mAMBS[idx]->setString(key, value);
 	return prt::STATUS_OK;
 }
@@ -25,7 +25,15 @@
 
 class AttrEvalCallbacks: public prt::Callbacks {
 public:
-	explicit AttrEvalCallbacks(AttributeMapBuilderVector& ambs, const std::vector<RuleFileInfoUPtr>& ruleFileInfo) : mAMBS(ambs), mRuleFileInfo(ruleFileInfo) { }
+	/**
+	 * hiddenAttributes holds the keys of the @Hidden rule attributes per initial shape (shared between shapes using the
+	 * same rule, see RuleFileInfoCache), nullptr for shapes without rule file info.
+	 * isIndices maps the initial shapes passed to prt::generate to their position within ambs/hiddenAttributes.
+	 * isIndexOffset is added to the isIndex of all callbacks before the mapping (used for batched generate calls).
+	 */
+	explicit AttrEvalCallbacks(AttributeMapBuilderVector& ambs, const std::vector<const WCharPtrSet*>& hiddenAttributes,
+	                           const std::vector<size_t>& isIndices, size_t isIndexOffset = 0)
+		: mAMBS(ambs), mHiddenAttributes(hiddenAttributes), mIsIndices(isIndices), mIsIndexOffset(isIndexOffset) { }
 	~AttrEvalCallbacks() override = default;
 
 	prt::Status generateError(size_t isIndex, prt::Status status, const wchar_t* message) override;
@@ -40,6 +48,13 @@ public:
 	prt::Status attrString(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* value) override;
 
 private:
+	bool isVisible(size_t idx, const wchar_t* key) const {
+		const WCharPtrSet* hidden = mHiddenAttributes[idx];
+		return (hidden != nullptr) && (hidden->count(key) == 0);
+	}
+
 	AttributeMapBuilderVector& mAMBS;
-	const std::vector<RuleFileInfoUPtr>& mRuleFileInfo;
+	const std::vector<const WCharPtrSet*>& mHiddenAttributes;
+	const std::vector<size_t>& mIsIndices;
+	const size_t mIsIndexOffset;
 };
@@ -17,21 +17,42 @@
 #include "AttributeConversion.h"
 #include "LRUCache.h"
 #include "LogHandler.h"
-#include "MultiWatch.h"
+#include "Tracer.h"
 
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/algorithm/string.hpp)
 
 #include <mutex>
 #include <bitset>
+#include <algorithm>
+#include <cwchar>
 
 
 namespace {
 
 constexpr bool DBG = false;
 
+// attribute values and attribute names are converted differently and therefore need separate caches
 namespace StringConversionCaches {
-	LockedLRUCache<std::wstring, UT_String> toPrimAttr(1 << 12);
+	ShardedLRUCache<UT_StringHolder> toPrimAttrValue(1 << 12);
+	ShardedLRUCache<UT_StringHolder> toPrimAttrName(1 << 12);
+}
+
+UT_StringHolder toPrimAttrValue(const wchar_t* value, size_t length) {
+	UT_StringHolder sh;
+	if (StringConversionCaches::toPrimAttrValue.get(value, length, sh))
+		return sh;
+	std::string nv;
+	toOSNarrowFromUTF16(value, length, nv);
+	return StringConversionCaches::toPrimAttrValue.insert(value, length, UT_StringHolder(nv));
+}
+
+UT_StringHolder toPrimAttrValue(const wchar_t* value) {
+	return toPrimAttrValue(value, std::wcslen(value));
+}
+
+UT_StringHolder toPrimAttrValue(const std::wstring& value) {
+	return toPrimAttrValue(value.c_str(), value.size());
 }
 
 template<typename H, typename V>
@@ -59,78 +80,162 @@ void setHandleRange(const GA_IndexMap& indexMap, const GA_RWHandleF& handle, GA_
 	if (DBG) LOG_DBG << "float attr: component = " << component << ", range = [" << start << ", " << start + size << "): " << handle.getAttribute()->getName() << " = " << value;
 }
 
+template<>
+void setHandleRange(const GA_IndexMap& indexMap, const GA_RWHandleD& handle, GA_Offset start, GA_Size size, int component, const double& value) {
+	const auto hv = static_cast<fpreal64>(value);
+	handle.setBlock(start, size, &hv, 0, component); // using stride = 0 to always set the same value
+	if (DBG) LOG_DBG << "double attr: component = " << component << ", range = [" << start << ", " << start + size << "): " << handle.getAttribute()->getName() << " = " << value;
+}
+
 template<>
 void setHandleRange(const GA_IndexMap& indexMap, GA_RWBatchHandleS& handle, GA_Offset start, GA_Size size, int component, const std::wstring& value) {
-    const UT_String attrValue = [&value]() {
-	    const auto sh = StringConversionCaches::toPrimAttr.get(value);
-	    if (sh)
-		    return sh.get();
-	    const std::string nv = toOSNarrowFromUTF16(value);
-	    UT_String hv(UT_String::ALWAYS_DEEP, nv); // ensure owning UT_String inside cache
-	    StringConversionCaches::toPrimAttr.insert(value, hv);
-	    return hv;
-    }();
+	const UT_StringHolder attrValue = toPrimAttrValue(value);
 
 	const GA_Range range(indexMap, start, start+size);
 	handle.set(range, component, attrValue);
 
-    if (DBG) LOG_DBG << "string attr: range = [" << start << ", " << start + size << "): " << handle.getAttribute()->getName() << " = " << attrValue;
+	if (DBG) LOG_DBG << "string attr: range = [" << start << ", " << start + size << "): " << handle.getAttribute()->getName() << " = " << attrValue.toStdString();
+}
+
+// writes the same array value into all primitives of the range, A is one of the UT_*Array types
+template<typename H, typename A>
+void setArrayRange(H& handle, GA_Offset start, GA_Size size, const A& values) {
+	for (GA_Offset off = start; off < start + size; ++off)
+		handle.set(off, values);
+	if (DBG) LOG_DBG << "array attr: range = [" << start << ", " << start + size << "): " << handle.getAttribute()->getName() << ", #elements = " << values.size();
+}
+
+// guards against arrays which are longer than the tuple size determined by the first occurrence of the attribute,
+// the warning is logged for the first face range only
+size_t getTupleComponents(const GA_Attribute* attr, size_t arraySize, bool& warned) {
+	const size_t tupleSize = static_cast<size_t>(attr->getTupleSize());
+	if (arraySize > tupleSize) {
+		if (!warned) {
+			warned = true;
+			LOG_WRN << "array attribute '" << attr->getName() << "' has " << arraySize << " elements but tuple size is "
+			        << tupleSize << ", dropping excess elements (consider native array storage)";
+		}
+		return tupleSize;
+	}
+	return arraySize;
 }
 
 class HandleVisitor : public PLD_BOOST_NS::static_visitor<> {
 private:
-	const AttributeConversion::ProtoHandle& protoHandle;
+	AttributeConversion::ProtoHandle&       protoHandle;
 	const prt::AttributeMap*                attrMap;
 	const GA_IndexMap&                      primIndexMap;
 	GA_Offset                               rangeStart;
 	GA_Size                                 rangeSize;
 
 public:
-	HandleVisitor(const AttributeConversion::ProtoHandle& ph, const prt::AttributeMap* m,
+	HandleVisitor(AttributeConversion::ProtoHandle& ph, const prt::AttributeMap* m,
 	              const GA_IndexMap& pim, GA_Offset rStart, GA_Size rSize)
 		: protoHandle(ph), attrMap(m), primIndexMap(pim), rangeStart(rStart), rangeSize(rSize) { }
 
-    void operator()(const AttributeConversion::NoHandle& handle) const { }
+	void operator()(const AttributeConversion::NoHandle& handle) const { }
 
-    void operator()(GA_RWBatchHandleS& handle) const {
-	    if (protoHandle.type == prt::Attributable::PT_STRING) {
-		    wchar_t const* const v = attrMap->getString(protoHandle.key.c_str());
-	    	if (v && std::wcslen(v) > 0) {
-			    setHandleRange(primIndexMap, handle, rangeStart, rangeSize, 0, std::wstring(v));
-		    }
-	    }
-	    else if (protoHandle.type == prt::Attributable::PT_STRING_ARRAY) {
+	void operator()(GA_RWBatchHandleS& handle) const {
+		if (protoHandle.type == prt::Attributable::PT_STRING) {
+			wchar_t const* const v = attrMap->getString(protoHandle.key.c_str());
+			if (v && std::wcslen(v) > 0) {
+				setHandleRange(primIndexMap, handle, rangeStart, rangeSize, 0, std::wstring(v));
+			}
+		}
+		else if (protoHandle.type == prt::Attributable::PT_STRING_ARRAY) {
 			size_t arraySize = 0;
 			wchar_t const* const* const v = attrMap->getStringArray(protoHandle.key.c_str(), &arraySize);
-			for (size_t i = 0; i < arraySize; i++) {
+			const size_t n = getTupleComponents(handle.getAttribute(), arraySize, protoHandle.truncationWarned);
+			for (size_t i = 0; i < n; i++) {
 				if (v && v[i] && std::wcslen(v[i]) > 0) {
 					setHandleRange(primIndexMap, handle, rangeStart, rangeSize, i, std::wstring(v[i]));
 				}
 			}
-	    }
-    }
+		}
+	}
 
-    void operator()(const GA_RWHandleI& handle) const {
+	void operator()(const GA_RWHandleI& handle) const {
 		if (protoHandle.type == prt::Attributable::PT_INT) {
 			const int32_t v = attrMap->getInt(protoHandle.key.c_str());
 			setHandleRange(primIndexMap, handle, rangeStart, rangeSize, 0, v);
 		}
 		else if (protoHandle.type == prt::Attributable::PT_INT_ARRAY) {
-			LOG_ERR << "int arrays not yet implemented";
+			size_t arraySize = 0;
+			const int32_t* const v = attrMap->getIntArray(protoHandle.key.c_str(), &arraySize);
+			const size_t n = getTupleComponents(handle.getAttribute(), arraySize, protoHandle.truncationWarned);
+			for (size_t i = 0; i < n; i++) {
+				setHandleRange(primIndexMap, handle, rangeStart, rangeSize, i, v[i]);
+			}
 		}
-    }
+	}
 
-    void operator()(const GA_RWHandleC& handle) const {
+	void operator()(const GA_RWHandleC& handle) const {
 		if (protoHandle.type == prt::Attributable::PT_BOOL) {
 			const bool v = attrMap->getBool(protoHandle.key.c_str());
 			setHandleRange(primIndexMap, handle, rangeStart, rangeSize, 0, v);
 		}
 		else if (protoHandle.type == prt::Attributable::PT_BOOL_ARRAY) {
-			LOG_ERR << "bool arrays not yet implemented";
+			size_t arraySize = 0;
+			const bool* const v = attrMap->getBoolArray(protoHandle.key.c_str(), &arraySize);
+			const size_t n = getTupleComponents(handle.getAttribute(), arraySize, protoHandle.truncationWarned);
+			for (size_t i = 0; i < n; i++) {
+				setHandleRange(primIndexMap, handle, rangeStart, rangeSize, i, v[i]);
+			}
 		}
-    }
+	}
 
-    void operator()(const GA_RWHandleF& handle) const {
+	void operator()(const GA_RWHandleF& handle) const {
+		setFloatTuple(handle);
+	}
+
+	void operator()(const GA_RWHandleD& handle) const {
+		setFloatTuple(handle);
+	}
+
+	void operator()(GA_RWHandleIA& handle) const {
+		size_t arraySize = 0;
+		UT_Int32Array values;
+		if (protoHandle.type == prt::Attributable::PT_INT_ARRAY) {
+			const int32_t* const v = attrMap->getIntArray(protoHandle.key.c_str(), &arraySize);
+			values.setSizeNoInit(arraySize);
+			for (size_t i = 0; i < arraySize; i++)
+				values[i] = v[i];
+		}
+		else if (protoHandle.type == prt::Attributable::PT_BOOL_ARRAY) {
+			const bool* const v = attrMap->getBoolArray(protoHandle.key.c_str(), &arraySize);
+			values.setSizeNoInit(arraySize);
+			for (size_t i = 0; i < arraySize; i++)
+				values[i] = v[i] ? 1 : 0;
+		}
+		else
+			return;
+		setArrayRange(handle, rangeStart, rangeSize, values);
+	}
+
+	void operator()(GA_RWHandleFA& handle) const {
+		setFloatArray<UT_Fpreal32Array>(handle);
+	}
+
+	void operator()(GA_RWHandleDA& handle) const {
+		setFloatArray<UT_Fpreal64Array>(handle);
+	}
+
+	void operator()(GA_RWHandleSA& handle) const {
+		if (protoHandle.type != prt::Attributable::PT_STRING_ARRAY)
+			return;
+
+		size_t arraySize = 0;
+		wchar_t const* const* const v = attrMap->getStringArray(protoHandle.key.c_str(), &arraySize);
+		UT_StringArray values;
+		values.setCapacity(arraySize);
+		for (size_t i = 0; i < arraySize; i++)
+			values.append(v[i] ? toPrimAttrValue(v[i]) : UT_StringHolder());
+		setArrayRange(handle, rangeStart, rangeSize, values);
+	}
+
+private:
+	template<typename H>
+	void setFloatTuple(const H& handle) const {
 		if (protoHandle.type == prt::Attributable::PT_FLOAT) {
 			const auto v = attrMap->getFloat(protoHandle.key.c_str());
 			setHandleRange(primIndexMap, handle, rangeStart, rangeSize, 0, v);
@@ -138,18 +243,31 @@ public:
 		else if (protoHandle.type == prt::Attributable::PT_FLOAT_ARRAY) {
 			size_t arraySize = 0;
 			const double* const v = attrMap->getFloatArray(protoHandle.key.c_str(), &arraySize);
-			for (size_t i = 0; i < arraySize; i++) {
+			const size_t n = getTupleComponents(handle.getAttribute(), arraySize, protoHandle.truncationWarned);
+			for (size_t i = 0; i < n; i++) {
 				setHandleRange(primIndexMap, handle, rangeStart, rangeSize, i, v[i]);
 			}
 		}
 	}
+
+	template<typename A, typename H>
+	void setFloatArray(H& handle) const {
+		if (protoHandle.type != prt::Attributable::PT_FLOAT_ARRAY)
+			return;
+
+		size_t arraySize = 0;
+		const double* const v = attrMap->getFloatArray(protoHandle.key.c_str(), &arraySize);
+		A values;
+		values.setSizeNoInit(arraySize);
+		for (size_t i = 0; i < arraySize; i++)
+			values[i] = static_cast<typename A::value_type>(v[i]);
+		setArrayRange(handle, rangeStart, rangeSize, values);
+	}
 };
 
 void addProtoHandle(AttributeConversion::HandleMap& handleMap, const std::wstring& handleName,
                     AttributeConversion::ProtoHandle&& ph)
 {
-	WA("all");
-
 	const UT_StringHolder& utName = NameConversion::toPrimAttr(handleName);
 	if (DBG) LOG_DBG << "handle name conversion: handleName = " << handleName << ", utName = " << utName;
 	handleMap.emplace(utName, std::move(ph));
@@ -182,6 +300,115 @@ size_t getAttributeCardinality(const prt::AttributeMap* attrMap, const std::wstr
 	return cardinality;
 }
 
+bool isArrayType(const prt::Attributable::PrimitiveType& type) {
+	switch (type) {
+		case prt::Attributable::PT_BOOL_ARRAY:
+		case prt::Attributable::PT_FLOAT_ARRAY:
+		case prt::Attributable::PT_INT_ARRAY:
+		case prt::Attributable::PT_STRING_ARRAY:
+			return true;
+		default:
+			return false;
+	}
+}
+
+AttributeConversion::HandleType createTupleHandle(GU_Detail* detail, const UT_StringHolder& utKey,
+                                                  const prt::Attributable::PrimitiveType& type, size_t cardinality,
+                                                  GA_Storage floatStorage)
+{
+	const int tupleSize = static_cast<int>(std::max<size_t>(cardinality, 1)); // empty arrays still need one component
+
+	AttributeConversion::HandleType handle; // set to NoHandle by default
+	assert(handle.which() == 0);
+	switch (type) {
+		case prt::Attributable::PT_BOOL:
+		case prt::Attributable::PT_BOOL_ARRAY: {
+			GA_RWHandleC h(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, utKey, tupleSize, GA_Defaults(0), nullptr, nullptr, GA_STORE_INT8));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		case prt::Attributable::PT_FLOAT:
+		case prt::Attributable::PT_FLOAT_ARRAY: {
+			GA_Attribute* a = detail->addFloatTuple(GA_ATTRIB_PRIMITIVE, utKey, tupleSize, GA_Defaults(0.0), nullptr, nullptr, floatStorage);
+			if (floatStorage == GA_STORE_REAL64) {
+				GA_RWHandleD h(a);
+				if (h.isValid())
+					handle = h;
+			}
+			else {
+				GA_RWHandleF h(a);
+				if (h.isValid())
+					handle = h;
+			}
+			break;
+		}
+		case prt::Attributable::PT_INT:
+		case prt::Attributable::PT_INT_ARRAY: {
+			GA_RWHandleI h(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, utKey, tupleSize));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		case prt::Attributable::PT_STRING:
+		case prt::Attributable::PT_STRING_ARRAY: {
+			GA_RWBatchHandleS h(detail->addStringTuple(GA_ATTRIB_PRIMITIVE, utKey, tupleSize));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		default:
+			if (DBG) LOG_DBG << "ignored: " << utKey;
+			break;
+	}
+	return handle;
+}
+
+AttributeConversion::HandleType createArrayHandle(GU_Detail* detail, const UT_StringHolder& utKey,
+                                                  const prt::Attributable::PrimitiveType& type, GA_Storage floatStorage)
+{
+	AttributeConversion::HandleType handle; // set to NoHandle by default
+	assert(handle.which() == 0);
+	switch (type) {
+		case prt::Attributable::PT_BOOL_ARRAY: {
+			GA_RWHandleIA h(detail->addIntArray(GA_ATTRIB_PRIMITIVE, utKey, 1, nullptr, nullptr, GA_STORE_INT8));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		case prt::Attributable::PT_FLOAT_ARRAY: {
+			GA_Attribute* a = detail->addFloatArray(GA_ATTRIB_PRIMITIVE, utKey, 1, nullptr, nullptr, floatStorage);
+			if (floatStorage == GA_STORE_REAL64) {
+				GA_RWHandleDA h(a);
+				if (h.isValid())
+					handle = h;
+			}
+			else {
+				GA_RWHandleFA h(a);
+				if (h.isValid())
+					handle = h;
+			}
+			break;
+		}
+		case prt::Attributable::PT_INT_ARRAY: {
+			GA_RWHandleIA h(detail->addIntArray(GA_ATTRIB_PRIMITIVE, utKey, 1));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		case prt::Attributable::PT_STRING_ARRAY: {
+			GA_RWHandleSA h(detail->addStringArray(GA_ATTRIB_PRIMITIVE, utKey, 1));
+			if (h.isValid())
+				handle = h;
+			break;
+		}
+		default:
+			if (DBG) LOG_DBG << "ignored: " << utKey;
+			break;
+	}
+	return handle;
+}
+
 } // namespace
 
 
@@ -201,48 +428,19 @@ void extractAttributeNames(HandleMap& handleMap, const prt::AttributeMap* attrMa
 	}
 }
 
-void createAttributeHandles(GU_Detail* detail, HandleMap& handleMap) {
+void createAttributeHandles(GU_Detail* detail, HandleMap& handleMap, const StorageOptions& storageOptions) {
 	WA("all");
 
+	const bool useArrays = (storageOptions.arrayStorage == ArrayStorage::ARRAY);
+	const GA_Storage floatStorage = (storageOptions.floatPrecision == FloatPrecision::DOUBLE) ? GA_STORE_REAL64 : GA_STORE_REAL32;
+
 	for (auto& hm: handleMap) {
 		const auto& utKey = hm.first;
 		const auto& type = hm.second.type;
 
-		HandleType handle; // set to NoHandle by default
-		assert(handle.which() == 0);
-		switch (type) {
-			case prt::Attributable::PT_BOOL:
-			case prt::Attributable::PT_BOOL_ARRAY: {
-				GA_RWHandleC h(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, utKey, hm.second.cardinality, GA_Defaults(0), nullptr, nullptr, GA_STORE_INT8));
-				if (h.isValid())
-					handle = h;
-				break;
-			}
-			case prt::Attributable::PT_FLOAT:
-			case prt::Attributable::PT_FLOAT_ARRAY: {
-				GA_RWHandleF h(detail->addFloatTuple(GA_ATTRIB_PRIMITIVE, utKey, hm.second.cardinality));
-				if (h.isValid())
-					handle = h;
-				break;
-			}
-			case prt::Attributable::PT_INT:
-			case prt::Attributable::PT_INT_ARRAY: {
-				GA_RWHandleI h(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, utKey, hm.second.cardinality));
-				if (h.isValid())
-					handle = h;
-				break;
-			}
-			case prt::Attributable::PT_STRING:
-			case prt::Attributable::PT_STRING_ARRAY: {
-				GA_RWBatchHandleS h(detail->addStringTuple(GA_ATTRIB_PRIMITIVE, utKey, hm.second.cardinality));
-				if (h.isValid())
-					handle = h;
-				break;
-			}
-			default:
-				if (DBG) LOG_DBG << "ignored: " << utKey;
-				break;
-		}
+		const HandleType handle = (useArrays && isArrayType(type))
+		                          ? createArrayHandle(detail, utKey, type, floatStorage)
+		                          : createTupleHandle(detail, utKey, type, hm.second.cardinality, floatStorage);
 
 		if (handle.which() != 0) {
 			hm.second.handleType = handle;
@@ -263,6 +461,15 @@ void setAttributeValues(HandleMap& handleMap, const prt::AttributeMap* attrMap,
 	}
 }
 
+void logConversionCacheStats() {
+	auto log = [](const wchar_t* name, const ShardedLRUCache<UT_StringHolder>::Stats& stats) {
+		LOG_DBG << name << L" conversion cache: size = " << stats.size << L"/" << stats.capacity
+		        << L", hits = " << stats.hits << L", misses = " << stats.misses << L", evictions = " << stats.evictions;
+	};
+	log(L"attribute value", StringConversionCaches::toPrimAttrValue.getStats());
+	log(L"attribute name", StringConversionCaches::toPrimAttrName.getStats());
+}
+
 } // namespace AttributeConversion
 
 
@@ -291,25 +498,19 @@ std::wstring removeStyle(const std::wstring& n) {
 	return n;
 }
 
-UT_String toPrimAttr(const std::wstring& name) {
-	WA("all");
-
-	const auto cv = StringConversionCaches::toPrimAttr.get(name);
-	if (cv)
-		return cv.get();
+UT_StringHolder toPrimAttr(const std::wstring& name) {
+	UT_StringHolder cv;
+	if (StringConversionCaches::toPrimAttrName.get(name.c_str(), name.size(), cv))
+		return cv;
 
 	std::string s = toOSNarrowFromUTF16(removeStyle(name));
 	for (size_t i = 0; i < RULE_ATTR_NAME_TO_PRIM_ATTR_N; i++)
 		PLD_BOOST_NS::replace_all(s, RULE_ATTR_NAME_TO_PRIM_ATTR[i][0], RULE_ATTR_NAME_TO_PRIM_ATTR[i][1]);
 
-	UT_String primAttr(UT_String::ALWAYS_DEEP, s); // ensure owning UT_String inside cache
-	StringConversionCaches::toPrimAttr.insert(name, primAttr);
-	return primAttr;
+	return StringConversionCaches::toPrimAttrName.insert(name.c_str(), name.size(), UT_StringHolder(s));
 }
 
 std::wstring toRuleAttr(const std::wstring& style, const UT_StringHolder& name) {
-	WA("all");
-
 	std::string s = name.toStdString();
 	for (size_t i = 0; i < RULE_ATTR_NAME_TO_PRIM_ATTR_N; i++)
 		PLD_BOOST_NS::replace_all(s, RULE_ATTR_NAME_TO_PRIM_ATTR[i][1], RULE_ATTR_NAME_TO_PRIM_ATTR[i][0]);
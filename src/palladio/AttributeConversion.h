@@ -43,10 +43,29 @@ namespace AttributeConversion {
  * wstring -> narrow string
  * int32_t -> int32_t
  * bool    -> int8_t
- * double  -> float (single precision!)
+ * double  -> float (single or double precision, see FloatPrecision)
+ *
+ * array types are either converted into attribute tuples (one component per array element)
+ * or into native Houdini array attributes, see ArrayStorage
  */
+enum class FloatPrecision { SINGLE, DOUBLE };
+enum class ArrayStorage { TUPLE, ARRAY };
+
+struct StorageOptions {
+	FloatPrecision floatPrecision = FloatPrecision::SINGLE;
+	ArrayStorage   arrayStorage   = ArrayStorage::TUPLE;
+};
+
+// storage options per class of emitted primitive attributes
+struct AttributeStorage {
+	StorageOptions ruleAttributes;
+	StorageOptions materials;
+	StorageOptions reports;
+};
+
 using NoHandle   = int8_t;
-using HandleType = PLD_BOOST_NS::variant<NoHandle, GA_RWBatchHandleS, GA_RWHandleI, GA_RWHandleC, GA_RWHandleF>;
+using HandleType = PLD_BOOST_NS::variant<NoHandle, GA_RWBatchHandleS, GA_RWHandleI, GA_RWHandleC, GA_RWHandleF,
+                                         GA_RWHandleD, GA_RWHandleIA, GA_RWHandleFA, GA_RWHandleDA, GA_RWHandleSA>;
 
 
 // bound to life time of PRT attribute map
@@ -55,15 +74,19 @@ struct ProtoHandle {
 	std::wstring                     key;
 	prt::AttributeMap::PrimitiveType type; // original PRT type
 	size_t                           cardinality;
+	bool                             truncationWarned = false; // see getTupleComponents, warn once per handle map
 };
 
 using HandleMap = std::unordered_map<UT_StringHolder, ProtoHandle>;
 
 PLD_TEST_EXPORTS_API void extractAttributeNames(HandleMap& handleMap, const prt::AttributeMap* attrMap);
-void createAttributeHandles(GU_Detail* detail, HandleMap& handleMap);
-void setAttributeValues(HandleMap& handleMap, const prt::AttributeMap* attrMap,
-                        const GA_IndexMap& primIndexMap, const GA_Offset rangeStart,
-                        const GA_Size rangeSize);
+PLD_TEST_EXPORTS_API void createAttributeHandles(GU_Detail* detail, HandleMap& handleMap, const StorageOptions& storageOptions);
+PLD_TEST_EXPORTS_API void setAttributeValues(HandleMap& handleMap, const prt::AttributeMap* attrMap,
+                                             const GA_IndexMap& primIndexMap, const GA_Offset rangeStart,
+                                             const GA_Size rangeSize);
+
+// logs hit/miss/eviction counters of the string conversion caches (debug level)
+void logConversionCacheStats();
 
 } // namespace AttributeConversion
 
@@ -74,7 +97,7 @@ std::wstring addStyle(const std::wstring& n, const std::wstring& style);
 std::wstring removeStyle(const std::wstring& n);
 PLD_TEST_EXPORTS_API void separate(const std::wstring& fqName, std::wstring& style, std::wstring& name);
 
-UT_String toPrimAttr(const std::wstring& name);
+PLD_TEST_EXPORTS_API UT_StringHolder toPrimAttr(const std::wstring& name);
 std::wstring toRuleAttr(const std::wstring& style, const UT_StringHolder& name);
 
 } // namespace NameConversion
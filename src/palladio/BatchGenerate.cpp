@@ -0,0 +1,94 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BatchGenerate.h"
+#include "LogHandler.h"
+
+#include <future>
+#include <algorithm>
+#include <string>
+
+
+namespace {
+
+const std::vector<std::string> BATCH_MODE_NAMES = { "occlusion", "generation" };
+
+} // namespace
+
+
+size_t getBatchRangeSize(size_t numShapes, size_t nThreads) {
+	return (nThreads > 0) ? numShapes / nThreads : numShapes;
+}
+
+size_t getBatchStart(size_t threadIndex, size_t isRangeSize) {
+	return threadIndex * isRangeSize;
+}
+
+std::vector<prt::Status> batchGenerate(BatchMode mode,
+                                       size_t nThreads,
+                                       const std::vector<prt::Callbacks*>& callbacks,
+                                       size_t isRangeSize,
+                                       const InitialShapeNOPtrVector& is,
+                                       const std::vector<const wchar_t*>& allEncoders,
+                                       const AttributeMapNOPtrVector& allEncoderOptions,
+                                       prt::OcclusionSet::Handle* occlusionHandles,
+                                       prt::OcclusionSet* occlusionSet,
+                                       prt::Cache* prtCache,
+                                       const prt::AttributeMap* genOpts)
+{
+	std::vector<prt::Status> batchStatus(nThreads, prt::STATUS_UNSPECIFIED_ERROR);
+
+	std::vector<std::future<void>> futures;
+	futures.reserve(nThreads);
+	for (size_t ti = 0; ti < nThreads; ti++) {
+		auto f = std::async(std::launch::async, [&,ti] { // capture thread index by value, else we have is range chaos
+			const size_t isStartPos = getBatchStart(ti, isRangeSize);
+			const size_t isPastEndPos = (ti < nThreads - 1) ? getBatchStart(ti + 1, isRangeSize) : is.size();
+			const size_t isActualRangeSize = isPastEndPos - isStartPos;
+			const auto isRangeStart = &is[isStartPos];
+			const auto isOcclRangeStart = (occlusionHandles != nullptr) ? occlusionHandles + isStartPos : nullptr;
+
+			LOG_DBG << "thread " << ti << ": #is = " << isActualRangeSize;
+
+			switch (mode) {
+				case BatchMode::OCCLUSION: {
+					batchStatus[ti] = prt::generateOccluders(isRangeStart, isActualRangeSize, isOcclRangeStart,
+					                                         nullptr, 0, nullptr, callbacks[ti], prtCache,
+					                                         occlusionSet, genOpts);
+					break;
+				}
+				case BatchMode::GENERATION: {
+					batchStatus[ti] = prt::generate(isRangeStart, isActualRangeSize, isOcclRangeStart,
+					                                allEncoders.data(), allEncoders.size(), allEncoderOptions.data(),
+					                                callbacks[ti], prtCache, occlusionSet, genOpts);
+					break;
+				}
+			}
+
+			if (batchStatus[ti] != prt::STATUS_OK) {
+				LOG_WRN << "batch mode " << BATCH_MODE_NAMES[(int)mode] << " failed with status: '"
+				        << prt::getStatusDescription(batchStatus[ti]) << "' ("
+				        << batchStatus[ti] << ")";
+			}
+
+		});
+		futures.emplace_back(std::move(f));
+	}
+	std::for_each(futures.begin(), futures.end(), [](std::future<void>& f) { f.wait(); });
+
+	return batchStatus;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Utils.h"
+
+#include "prt/API.h"
+#include "prt/Callbacks.h"
+
+#include <vector>
+
+
+enum class BatchMode { OCCLUSION, GENERATION };
+
+/**
+ * The initial shapes are split into nThreads consecutive batches of isRangeSize shapes (the last batch takes
+ * the remainder). Each batch is generated asynchronously with its own callbacks instance, i.e. the isIndex
+ * passed to callbacks[t] is relative to the batch start (see getBatchStart).
+ */
+size_t getBatchRangeSize(size_t numShapes, size_t nThreads);
+size_t getBatchStart(size_t threadIndex, size_t isRangeSize);
+
+/**
+ * occlusionHandles and occlusionSet are optional (nullptr) in GENERATION mode.
+ */
+std::vector<prt::Status> batchGenerate(BatchMode mode,
+                                       size_t nThreads,
+                                       const std::vector<prt::Callbacks*>& callbacks,
+                                       size_t isRangeSize,
+                                       const InitialShapeNOPtrVector& is,
+                                       const std::vector<const wchar_t*>& allEncoders,
+                                       const AttributeMapNOPtrVector& allEncoderOptions,
+                                       prt::OcclusionSet::Handle* occlusionHandles,
+                                       prt::OcclusionSet* occlusionSet,
+                                       prt::Cache* prtCache,
+                                       const prt::AttributeMap* genOpts);
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "DefaultAttributeCache.h"
+#include "LogHandler.h"
+
+#include <cwchar>
+
+
+namespace {
+
+constexpr bool   DBG                = false;
+constexpr size_t MAX_SHAPE_ENTRIES  = 1 << 18; // we simply start over if the cache grows too large
+
+template<typename C, typename P>
+void eraseIf(C& c, P pred) {
+	for (auto it = c.begin(); it != c.end();) {
+		if (pred(it->first))
+			it = c.erase(it);
+		else
+			++it;
+	}
+}
+
+bool equalAttributeValues(const prt::AttributeMap* a, const prt::AttributeMap* b, const wchar_t* key) {
+	if (!b->hasKey(key) || a->getType(key) != b->getType(key))
+		return false;
+
+	switch (a->getType(key)) {
+		case prt::AttributeMap::PT_BOOL:
+			return (a->getBool(key) == b->getBool(key));
+		case prt::AttributeMap::PT_FLOAT:
+			return (a->getFloat(key) == b->getFloat(key));
+		case prt::AttributeMap::PT_INT:
+			return (a->getInt(key) == b->getInt(key));
+		case prt::AttributeMap::PT_STRING: {
+			const wchar_t* av = a->getString(key);
+			const wchar_t* bv = b->getString(key);
+			return (av == nullptr) ? (bv == nullptr) : (bv != nullptr && std::wcscmp(av, bv) == 0);
+		}
+		default: // default rule attributes are never arrays, see AttrEvalCallbacks
+			return false;
+	}
+}
+
+} // namespace
+
+
+DefaultAttributeCache::AttributeMapSPtr DefaultAttributeCache::get(const ShapeKey& key) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	const auto it = mShapeEntries.find(key);
+	return (it != mShapeEntries.end()) ? it->second : AttributeMapSPtr();
+}
+
+void DefaultAttributeCache::insert(const ShapeKey& key, const AttributeMapSPtr& defaultAttributes) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mShapeEntries.size() >= MAX_SHAPE_ENTRIES) {
+		LOG_DBG << "default attribute cache is full, clearing " << mShapeEntries.size() << " entries";
+		mShapeEntries.clear();
+	}
+	mShapeEntries[key] = defaultAttributes;
+}
+
+DefaultAttributeCache::Invariance DefaultAttributeCache::getInvariance(const RuleKey& key, AttributeMapSPtr& invariantAttributes) const {
+	std::lock_guard<std::mutex> lock(mMutex);
+	const auto it = mRuleEntries.find(key);
+	if (it == mRuleEntries.end())
+		return Invariance::UNKNOWN;
+	invariantAttributes = it->second.mInvariantAttributes;
+	return it->second.mInvariance;
+}
+
+void DefaultAttributeCache::setInvariance(const RuleKey& key, Invariance invariance, const AttributeMapSPtr& invariantAttributes) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	const bool hasAttributes = (invariance == Invariance::INVARIANT || invariance == Invariance::PARTIALLY_INVARIANT);
+	mRuleEntries[key] = { invariance, hasAttributes ? invariantAttributes : AttributeMapSPtr() };
+	if (DBG) LOG_DBG << "rule " << key.ruleFile << " / " << key.startRule << " invariance: " << static_cast<int>(invariance);
+}
+
+void DefaultAttributeCache::invalidate(const std::string& rpk) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	eraseIf(mShapeEntries, [&rpk](const ShapeKey& k) { return k.ruleKey.rpk == rpk; });
+	eraseIf(mRuleEntries, [&rpk](const RuleKey& k) { return k.rpk == rpk; });
+}
+
+bool equalAttributeMaps(const prt::AttributeMap* a, const prt::AttributeMap* b) {
+	size_t aKeyCount = 0, bKeyCount = 0;
+	wchar_t const* const* aKeys = a->getKeys(&aKeyCount);
+	b->getKeys(&bKeyCount);
+	if (aKeyCount != bKeyCount)
+		return false;
+
+	for (size_t k = 0; k < aKeyCount; k++) {
+		if (!equalAttributeValues(a, b, aKeys[k]))
+			return false;
+	}
+	return true;
+}
+
+AttributeMapUPtr createEqualAttributeMap(const prt::AttributeMap* a, const prt::AttributeMap* b) {
+	AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+
+	size_t aKeyCount = 0;
+	wchar_t const* const* aKeys = a->getKeys(&aKeyCount);
+	for (size_t k = 0; k < aKeyCount; k++) {
+		const wchar_t* key = aKeys[k];
+		if (!equalAttributeValues(a, b, key))
+			continue;
+
+		switch (a->getType(key)) {
+			case prt::AttributeMap::PT_BOOL:
+				amb->setBool(key, a->getBool(key));
+				break;
+			case prt::AttributeMap::PT_FLOAT:
+				amb->setFloat(key, a->getFloat(key));
+				break;
+			case prt::AttributeMap::PT_INT:
+				amb->setInt(key, a->getInt(key));
+				break;
+			case prt::AttributeMap::PT_STRING:
+				amb->setString(key, a->getString(key));
+				break;
+			default: // see equalAttributeValues
+				break;
+		}
+	}
+
+	return AttributeMapUPtr(amb->createAttributeMap());
+}
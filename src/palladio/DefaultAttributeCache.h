@@ -0,0 +1,100 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "Utils.h"
+
+#include "prt/AttributeMap.h"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <tuple>
+
+
+/**
+ * Memoizes the evaluated default rule attributes of initial shapes (see SOPAssign). Entries are keyed by all
+ * inputs of the evaluation and are dropped when their rule package is reloaded (see PRTContext::getResolveMap).
+ *
+ * Optionally, the default rule attributes of a rule can be classified per attribute as "invariant": their values
+ * depend neither on the initial shape geometry nor on the random seed. This is detected by evaluating a few different
+ * probe shapes and is a heuristic: a dependency which none of the probes reveals (e.g. a threshold on the shape area
+ * or height) leads to the probe value being used for all shapes.
+ */
+class DefaultAttributeCache {
+public:
+	using AttributeMapSPtr = std::shared_ptr<const prt::AttributeMap>;
+
+	struct RuleKey {
+		std::string  rpk;
+		std::wstring ruleFile;
+		std::wstring style;
+		std::wstring startRule;
+
+		bool operator<(const RuleKey& rhs) const {
+			return std::tie(rpk, ruleFile, style, startRule) < std::tie(rhs.rpk, rhs.ruleFile, rhs.style, rhs.startRule);
+		}
+	};
+
+	struct ShapeKey {
+		RuleKey ruleKey;
+		int32_t randomSeed;
+		size_t  geometryHash;
+
+		bool operator<(const ShapeKey& rhs) const {
+			return std::tie(ruleKey, randomSeed, geometryHash) < std::tie(rhs.ruleKey, rhs.randomSeed, rhs.geometryHash);
+		}
+	};
+
+	// PARTIALLY_INVARIANT: only some default rule attributes are shared, the others are evaluated per shape
+	enum class Invariance { UNKNOWN, INVARIANT, PARTIALLY_INVARIANT, VARIANT };
+
+	DefaultAttributeCache() = default;
+	DefaultAttributeCache(const DefaultAttributeCache&) = delete;
+	DefaultAttributeCache(DefaultAttributeCache&&) = delete;
+	DefaultAttributeCache& operator=(DefaultAttributeCache const&) = delete;
+	DefaultAttributeCache& operator=(DefaultAttributeCache&&) = delete;
+
+	AttributeMapSPtr get(const ShapeKey& key) const;
+	void insert(const ShapeKey& key, const AttributeMapSPtr& defaultAttributes);
+
+	Invariance getInvariance(const RuleKey& key, AttributeMapSPtr& invariantAttributes) const;
+	void setInvariance(const RuleKey& key, Invariance invariance, const AttributeMapSPtr& invariantAttributes);
+
+	void invalidate(const std::string& rpk);
+
+private:
+	struct InvarianceEntry {
+		Invariance       mInvariance;
+		AttributeMapSPtr mInvariantAttributes;
+	};
+
+	mutable std::mutex                       mMutex;
+	std::map<ShapeKey, AttributeMapSPtr>     mShapeEntries;
+	std::map<RuleKey, InvarianceEntry>       mRuleEntries;
+};
+
+using DefaultAttributeCacheUPtr = std::unique_ptr<DefaultAttributeCache>;
+
+PLD_TEST_EXPORTS_API bool equalAttributeMaps(const prt::AttributeMap* a, const prt::AttributeMap* b);
+
+/**
+ * returns the attributes which are present in both maps with equal type and value
+ */
+PLD_TEST_EXPORTS_API AttributeMapUPtr createEqualAttributeMap(const prt::AttributeMap* a, const prt::AttributeMap* b);
@@ -1,138 +1,3 @@
-# pragma once
-
-#include "BoostRedirect.h"
-#include PLD_BOOST_INCLUDE(/optional.hpp)
-
-#include <list>
-#include <map>
-#include <mutex>
-
-
-// shamelessly copied from boost (houdini's hboost does not include this header)
-// http://www.boost.org/doc/libs/1_66_0/boost/compute/detail/lru_cache.hpp
-
-//---------------------------------------------------------------------------//
-// Copyright (c) 2013 Kyle Lutz <kyle.r.lutz@gmail.com>
-//
-// Distributed under the Boost Software License, Version 1.0
-// See accompanying file LICENSE_1_0.txt or copy at
-// http://www.boost.org/LICENSE_1_0.txt
-//
-// See http://boostorg.github.com/compute for more information.
-//---------------------------------------------------------------------------//
-
-// a cache which evicts the least recently used item when it is full
-template<class Key, class Value>
-class lru_cache
-{
-public:
-    typedef Key key_type;
-    typedef Value value_type;
-    typedef std::list<key_type> list_type;
-    typedef std::map<
-                key_type,
-                std::pair<value_type, typename list_type::iterator>
-            > map_type;
-
-    lru_cache(size_t capacity)
-        : m_capacity(capacity)
-    {
-    }
-
-    ~lru_cache()
-    {
-    }
-
-    size_t size() const
-    {
-        return m_map.size();
-    }
-
-    size_t capacity() const
-    {
-        return m_capacity;
-    }
-
-    bool empty() const
-    {
-        return m_map.empty();
-    }
-
-    bool contains(const key_type &key)
-    {
-        return m_map.find(key) != m_map.end();
-    }
-
-    void insert(const key_type &key, const value_type &value)
-    {
-        typename map_type::iterator i = m_map.find(key);
-        if(i == m_map.end()){
-            // insert item into the mCache, but first check if it is full
-            if(size() >= m_capacity){
-                // mCache is full, evict the least recently used item
-                evict();
-            }
-
-            // insert the new item
-            m_list.push_front(key);
-            m_map[key] = std::make_pair(value, m_list.begin());
-        }
-    }
-
-    PLD_BOOST_NS::optional<value_type> get(const key_type &key)
-    {
-        // lookup value in the mCache
-        typename map_type::iterator i = m_map.find(key);
-        if(i == m_map.end()){
-            // value not in mCache
-            return PLD_BOOST_NS::none;
-        }
-
-        // return the value, but first update its place in the most
-        // recently used list
-        typename list_type::iterator j = i->second.second;
-        if(j != m_list.begin()){
-            // move item to the front of the most recently used list
-            m_list.erase(j);
-            m_list.push_front(key);
-
-            // update iterator in map
-            j = m_list.begin();
-            const value_type &value = i->second.first;
-            m_map[key] = std::make_pair(value, j);
-
-            // return the value
-            return value;
-        }
-        else {
-            // the item is already at the front of the most recently
-            // used list so just return it
-            return i->second.first;
-        }
-    }
-
-    void clear()
-    {
-        m_map.clear();
-        m_list.clear();
-    }
-
-private:
-    void evict()
-    {
-        // evict item from the end of most recently used list
-        typename list_type::iterator i = --m_list.end();
-        m_map.erase(*i);
-        m_list.erase(i);
-    }
-
-private:
-    map_type m_map;
-    list_type m_list;
-    size_t m_capacity;
-};
-
-
 /*
  * Copyright 2014-2019 Esri R&D Zurich and VRBN
  *
@@ -149,45 +14,297 @@ private:
  * limitations under the License.
  */
 
-#undef LOCKED_LRU_CACHE_STATS
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cwchar>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * A cache with wide string keys which evicts the least recently used item when it is full.
+ *
+ * All nodes live in one preallocated vector and are linked into a hash bucket chain and into the LRU list by index,
+ * i.e. hits only relink indices and a full cache recycles the least recently used node in place. Lookups work on
+ * raw (pointer, length) keys, no std::wstring is constructed for a lookup and keys/values are never copied on hits.
+ */
+template<typename V>
+class LRUCache {
+public:
+	using value_type = V;
+
+	explicit LRUCache(size_t capacity)
+		: mCapacity(std::max<size_t>(capacity, 1)), mBuckets(getBucketCount(mCapacity), NIL), mBucketMask(mBuckets.size() - 1)
+	{
+		mNodes.reserve(mCapacity);
+	}
+
+	LRUCache(const LRUCache&) = delete;
+	LRUCache& operator=(const LRUCache&) = delete;
+
+	size_t size() const { return mNodes.size(); }
+	size_t capacity() const { return mCapacity; }
+	bool empty() const { return mNodes.empty(); }
+	uint64_t evictions() const { return mEvictions; }
+
+	static size_t getHash(const wchar_t* key, size_t keyLength) {
+		// FNV-1a
+		size_t h = (sizeof(size_t) == 8) ? static_cast<size_t>(14695981039346656037ULL) : 2166136261U;
+		const size_t prime = (sizeof(size_t) == 8) ? static_cast<size_t>(1099511628211ULL) : 16777619U;
+		for (size_t i = 0; i < keyLength; i++) {
+			h ^= static_cast<size_t>(key[i]);
+			h *= prime;
+		}
+		return h;
+	}
+
+	bool contains(const wchar_t* key, size_t keyLength) const {
+		return find(getHash(key, keyLength), key, keyLength) != NIL;
+	}
+
+	// returns nullptr if key is not present, the pointer is valid until the next insert
+	const V* get(const wchar_t* key, size_t keyLength) {
+		return get(getHash(key, keyLength), key, keyLength);
+	}
+
+	// same as above with a hash precomputed by getHash()
+	const V* get(size_t hash, const wchar_t* key, size_t keyLength) {
+		const uint32_t idx = find(hash, key, keyLength);
+		if (idx == NIL)
+			return nullptr;
+		moveToFront(idx);
+		return &mNodes[idx].value;
+	}
+
+	const V* get(const std::wstring& key) {
+		return get(key.c_str(), key.size());
+	}
+
+	// does not overwrite the value of an existing key, returns the cached value
+	const V& insert(const wchar_t* key, size_t keyLength, V&& value) {
+		return insert(getHash(key, keyLength), key, keyLength, std::move(value));
+	}
+
+	const V& insert(size_t hash, const wchar_t* key, size_t keyLength, V&& value) {
+		uint32_t idx = find(hash, key, keyLength);
+		if (idx != NIL) {
+			moveToFront(idx);
+			return mNodes[idx].value;
+		}
+
+		if (mNodes.size() < mCapacity) {
+			idx = static_cast<uint32_t>(mNodes.size());
+			mNodes.emplace_back();
+		}
+		else { // recycle the least recently used node
+			idx = mTail;
+			unlinkList(idx);
+			unlinkBucket(idx);
+			mEvictions++;
+		}
+
+		Node& n = mNodes[idx];
+		n.key.assign(key, keyLength); // reuses the capacity of a recycled key
+		n.value = std::move(value);
+		n.hash = hash;
+		n.bucketNext = mBuckets[hash & mBucketMask];
+		mBuckets[hash & mBucketMask] = idx;
+		pushFront(idx);
+		return n.value;
+	}
+
+	const V& insert(const std::wstring& key, V&& value) {
+		return insert(key.c_str(), key.size(), std::move(value));
+	}
+
+	void clear() {
+		mNodes.clear();
+		std::fill(mBuckets.begin(), mBuckets.end(), NIL);
+		mHead = mTail = NIL;
+	}
 
-template<typename K, typename V>
-class LockedLRUCache : public lru_cache<K,V> {
 private:
-	using Base = lru_cache<K,V>;
+	static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+	struct Node {
+		std::wstring key;
+		V            value;
+		size_t       hash       = 0;
+		uint32_t     prev       = NIL;
+		uint32_t     next       = NIL;
+		uint32_t     bucketNext = NIL;
+	};
+
+	static size_t getBucketCount(size_t capacity) {
+		size_t n = 1;
+		while (n < 2 * capacity) // load factor <= 0.5
+			n <<= 1;
+		return n;
+	}
 
-    std::mutex mMutex;
+	uint32_t find(size_t hash, const wchar_t* key, size_t keyLength) const {
+		for (uint32_t i = mBuckets[hash & mBucketMask]; i != NIL; i = mNodes[i].bucketNext) {
+			const Node& n = mNodes[i];
+			if (n.hash == hash && n.key.size() == keyLength && std::wmemcmp(n.key.data(), key, keyLength) == 0)
+				return i;
+		}
+		return NIL;
+	}
+
+	void unlinkBucket(uint32_t idx) {
+		uint32_t* link = &mBuckets[mNodes[idx].hash & mBucketMask];
+		while (*link != idx)
+			link = &mNodes[*link].bucketNext;
+		*link = mNodes[idx].bucketNext;
+	}
+
+	void unlinkList(uint32_t idx) {
+		Node& n = mNodes[idx];
+		if (n.prev != NIL) mNodes[n.prev].next = n.next; else mHead = n.next;
+		if (n.next != NIL) mNodes[n.next].prev = n.prev; else mTail = n.prev;
+		n.prev = n.next = NIL;
+	}
+
+	void pushFront(uint32_t idx) {
+		Node& n = mNodes[idx];
+		n.prev = NIL;
+		n.next = mHead;
+		if (mHead != NIL)
+			mNodes[mHead].prev = idx;
+		mHead = idx;
+		if (mTail == NIL)
+			mTail = idx;
+	}
 
-#ifdef LOCKED_LRU_CACHE_STATS
-	size_t hits = 0;
-	size_t misses = 0;
-#endif
+	void moveToFront(uint32_t idx) {
+		if (idx == mHead)
+			return;
+		unlinkList(idx);
+		pushFront(idx);
+	}
 
+	const size_t          mCapacity;
+	std::vector<Node>     mNodes;
+	std::vector<uint32_t> mBuckets;
+	const size_t          mBucketMask;
+	uint32_t              mHead = NIL;
+	uint32_t              mTail = NIL;
+	uint64_t              mEvictions = 0;
+};
+
+template<typename V>
+constexpr uint32_t LRUCache<V>::NIL;
+
+
+/**
+ * thread-safe LRUCache, values are returned by copy (i.e. use cheap to copy types like UT_StringHolder)
+ *
+ * The keys are distributed by hash onto independently locked shards (each an LRUCache with its share of the capacity),
+ * i.e. concurrent lookups only contend if they hit the same shard. Eviction is least recently used per shard.
+ */
+template<typename V>
+class ShardedLRUCache {
 public:
-	LockedLRUCache(size_t capacity) : Base{capacity} { }
+	static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+	static constexpr size_t MAX_SHARD_COUNT = 256;
+
+	struct Stats {
+		uint64_t hits      = 0;
+		uint64_t misses    = 0;
+		uint64_t evictions = 0;
+		size_t   size      = 0;
+		size_t   capacity  = 0;
+	};
+
+	explicit ShardedLRUCache(size_t capacity, size_t shardCount = DEFAULT_SHARD_COUNT) {
+		size_t n = 1;
+		while (n < std::min(shardCount, MAX_SHARD_COUNT))
+			n <<= 1;
+		mShardMask = n - 1;
+
+		const size_t shardCapacity = (std::max<size_t>(capacity, 1) + n - 1) / n;
+		mShards.reserve(n);
+		for (size_t i = 0; i < n; i++)
+			mShards.emplace_back(new Shard(shardCapacity));
+	}
+
+	ShardedLRUCache(const ShardedLRUCache&) = delete;
+	ShardedLRUCache& operator=(const ShardedLRUCache&) = delete;
+
+	bool get(const wchar_t* key, size_t keyLength, V& value) {
+		const size_t hash = LRUCache<V>::getHash(key, keyLength);
+		Shard& shard = getShard(hash);
+
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		const V* v = shard.cache.get(hash, key, keyLength);
+		if (v == nullptr) {
+			shard.misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		shard.hits.fetch_add(1, std::memory_order_relaxed);
+		value = *v;
+		return true;
+	}
+
+	// does not overwrite the value of an existing key, returns the cached value
+	V insert(const wchar_t* key, size_t keyLength, V&& value) {
+		const size_t hash = LRUCache<V>::getHash(key, keyLength);
+		Shard& shard = getShard(hash);
+
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		return shard.cache.insert(hash, key, keyLength, std::move(value));
+	}
 
-	~LockedLRUCache() {
-#ifdef LOCKED_LRU_CACHE_STATS
-		std::wcout << L"~LockedLRUCache: capacity = " << this->capacity() << L", size = " << this->size() << L", hits = " << hits << L", misses = " << misses << std::endl;
-#endif
+	void clear() {
+		for (auto& shard: mShards) {
+			std::lock_guard<std::mutex> guard(shard->mutex);
+			shard->cache.clear();
+		}
 	}
 
-    void insert(const K& key, const V& value) {
-		std::lock_guard<std::mutex> guard(mMutex);
-        Base::insert(key, value);
-    }
+	Stats getStats() const {
+		Stats stats;
+		for (const auto& shard: mShards) {
+			stats.hits   += shard->hits.load(std::memory_order_relaxed);
+			stats.misses += shard->misses.load(std::memory_order_relaxed);
+
+			std::lock_guard<std::mutex> guard(shard->mutex);
+			stats.evictions += shard->cache.evictions();
+			stats.size      += shard->cache.size();
+			stats.capacity  += shard->cache.capacity();
+		}
+		return stats;
+	}
 
-    PLD_BOOST_NS::optional<V> get(const K& key) {
-		std::lock_guard<std::mutex> guard(mMutex);
-        auto v = Base::get(key);
+	size_t getShardCount() const { return mShards.size(); }
 
-#ifdef LOCKED_LRU_CACHE_STATS
-		if (v)
-			hits++;
-        else
-            misses++;
-#endif
+private:
+	struct Shard {
+		explicit Shard(size_t capacity) : cache(capacity) { }
+
+		mutable std::mutex    mutex;
+		LRUCache<V>           cache;
+		std::atomic<uint64_t> hits{0};
+		std::atomic<uint64_t> misses{0};
+	};
+
+	Shard& getShard(size_t hash) {
+		// the shard cache uses the low bits for its buckets, use the high bits to pick the shard
+		return *mShards[(hash >> (sizeof(size_t) * 8 - 8)) & mShardMask];
+	}
 
-        return v;
-    }
+	std::vector<std::unique_ptr<Shard>> mShards;
+	size_t                              mShardMask = 0;
 };
+
+template<typename V>
+constexpr size_t ShardedLRUCache<V>::DEFAULT_SHARD_COUNT;
+template<typename V>
+constexpr size_t ShardedLRUCache<V>::MAX_SHARD_COUNT;
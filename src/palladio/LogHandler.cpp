@@ -0,0 +1,372 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LogHandler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cwchar>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+
+namespace {
+
+constexpr prt::LogLevel PRT_LOG_LEVEL_DEFAULT   = prt::LOG_ERROR;
+constexpr const char*   PRT_LOG_LEVEL_ENV_VAR   = "CITYENGINE_LOG_LEVEL";
+constexpr const char*   PRT_LOG_LEVEL_STRINGS[] = { "trace", "debug", "info", "warning", "error", "fatal" };
+constexpr size_t        PRT_LOG_LEVEL_STRINGS_N = sizeof(PRT_LOG_LEVEL_STRINGS)/sizeof(PRT_LOG_LEVEL_STRINGS[0]);
+
+std::atomic<int> activeLogLevel(PRT_LOG_LEVEL_DEFAULT);
+
+} // namespace
+
+
+namespace logging {
+
+prt::LogLevel getLogLevelFromEnvironment() {
+	const char* e = std::getenv(PRT_LOG_LEVEL_ENV_VAR);
+	if (e == nullptr || std::strlen(e) == 0)
+		return PRT_LOG_LEVEL_DEFAULT;
+	for (size_t i = 0; i < PRT_LOG_LEVEL_STRINGS_N; i++)
+		if (std::strcmp(e, PRT_LOG_LEVEL_STRINGS[i]) == 0)
+			return static_cast<prt::LogLevel>(i);
+	return PRT_LOG_LEVEL_DEFAULT;
+}
+
+prt::LogLevel getLogLevel() {
+	return static_cast<prt::LogLevel>(activeLogLevel.load(std::memory_order_relaxed));
+}
+
+void setLogLevel(prt::LogLevel level) {
+	activeLogLevel.store(level, std::memory_order_relaxed);
+	prt::setLogLevel(level);
+}
+
+} // namespace logging
+
+
+namespace {
+
+constexpr const char* LOG_FILE_ENV_VAR        = "PALLADIO_LOG_FILE";
+constexpr size_t      LOG_BUFFER_CAPACITY     = 1 << 12; // messages, must be a power of two
+constexpr size_t      LOG_RATE_LIMIT          = 200;     // messages per second, errors are not limited
+constexpr auto        LOG_DRAIN_INTERVAL      = std::chrono::milliseconds(50);
+
+struct LogMessage {
+	prt::LogLevel level = prt::LOG_INFO;
+	std::wstring  text;
+};
+
+/**
+ * bounded multi-producer single-consumer queue (after D. Vyukov), producers never block
+ */
+class LogRingBuffer {
+public:
+	explicit LogRingBuffer(size_t capacity) : mCells(new Cell[capacity]), mMask(capacity - 1) {
+		for (size_t i = 0; i < capacity; i++)
+			mCells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// returns false if the buffer is full
+	bool push(LogMessage&& message) {
+		size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell& cell = mCells[pos & mMask];
+			const size_t seq = cell.sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (diff == 0) {
+				if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.message = std::move(message);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;
+			else
+				pos = mEnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	// must only be called from the consumer thread
+	bool pop(LogMessage& message) {
+		Cell& cell = mCells[mDequeuePos & mMask];
+		const size_t seq = cell.sequence.load(std::memory_order_acquire);
+		if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(mDequeuePos + 1) < 0)
+			return false;
+		message = std::move(cell.message);
+		cell.sequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+		mDequeuePos++;
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		LogMessage          message;
+	};
+
+	std::unique_ptr<Cell[]> mCells;
+	const size_t            mMask;
+	std::atomic<size_t>     mEnqueuePos{0};
+	size_t                  mDequeuePos = 0;
+};
+
+std::wstring getTimeStamp() {
+	const std::time_t now = std::time(nullptr);
+	std::tm t;
+#ifdef _WIN32
+	localtime_s(&t, &now);
+#else
+	localtime_r(&now, &t);
+#endif
+	wchar_t buf[32];
+	const size_t n = std::wcsftime(buf, sizeof(buf)/sizeof(buf[0]), L"%Y-%m-%d %H:%M:%S", &t);
+	return std::wstring(buf, n);
+}
+
+// does not depend on PRT or the C++ locale, the sink still writes after PRT has been shut down
+std::string toUTF8(const std::wstring& s) {
+	std::string r;
+	r.reserve(s.size());
+	for (size_t i = 0; i < s.size(); i++) {
+		uint32_t c = static_cast<uint32_t>(s[i]);
+		if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF && i + 1 < s.size()) { // UTF-16 surrogate pair
+			const uint32_t low = static_cast<uint32_t>(s[i + 1]);
+			if (low >= 0xDC00 && low <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i++;
+			}
+		}
+
+		if (c < 0x80)
+			r.push_back(static_cast<char>(c));
+		else if (c < 0x800) {
+			r.push_back(static_cast<char>(0xC0 | (c >> 6)));
+			r.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000) {
+			r.push_back(static_cast<char>(0xE0 | (c >> 12)));
+			r.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			r.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x110000) {
+			r.push_back(static_cast<char>(0xF0 | (c >> 18)));
+			r.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+			r.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			r.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		}
+		else
+			r.push_back('?');
+	}
+	return r;
+}
+
+} // namespace
+
+
+namespace logging {
+
+class LogSink {
+public:
+	explicit LogSink(const std::wstring& name) : mName(name), mBuffer(LOG_BUFFER_CAPACITY) {
+		const char* logFile = std::getenv(LOG_FILE_ENV_VAR);
+		if (logFile != nullptr && std::strlen(logFile) > 0) {
+			mFilePath = logFile;
+			mFile.open(mFilePath, std::ios::out | std::ios::app);
+			if (!mFile)
+				std::wcerr << L"[" << mName << L"] could not open log file '" << logFile << L"', logging to console" << std::endl;
+		}
+		mThread = std::thread([this]() { run(); });
+	}
+
+	~LogSink() {
+		{
+			std::lock_guard<std::mutex> lock(mWaitMutex);
+			mStop = true;
+		}
+		mWaitCondition.notify_one();
+		mThread.join();
+	}
+
+	void push(const wchar_t* msg, prt::LogLevel level) {
+		LogMessage m;
+		m.level = level;
+		m.text.assign(msg);
+		if (mBuffer.push(std::move(m)))
+			mWaitCondition.notify_one();
+		else if (level >= prt::LOG_ERROR) { // errors are never dropped, they take the slow path if the buffer is full
+			std::lock_guard<std::mutex> lock(mOverflowMutex);
+			mOverflow.emplace_back(std::move(m));
+		}
+		else
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// the log file is written as UTF-8, a wide file stream would fail on the first non-ASCII character
+	void write(const std::wstring& text) {
+		const std::wstring line = getTimeStamp() + L" [" + mName + L"] " + text + L'\n';
+		if (mFile.is_open()) {
+			const std::string utf8Line = toUTF8(line);
+			mFile.write(utf8Line.data(), utf8Line.size());
+			if (!mFile)
+				reopenFile();
+		}
+		else {
+			std::wcout << line;
+			if (!std::wcout)
+				std::wcout.clear(); // e.g. a character which is not representable in the console locale
+		}
+	}
+
+	void flush() {
+		if (mFile.is_open()) {
+			mFile.flush();
+			if (!mFile)
+				reopenFile();
+		}
+		else {
+			std::wcout.flush();
+			std::wcout.clear();
+		}
+	}
+
+	// a failed stream would swallow all further messages, falls back to the console if the file cannot be reopened
+	void reopenFile() {
+		mFile.close();
+		mFile.clear();
+		mFile.open(mFilePath, std::ios::out | std::ios::app);
+		if (!mFile)
+			std::wcerr << L"[" << mName << L"] could not write to log file, logging to console" << std::endl;
+	}
+
+	void writeRepeated() {
+		if (mRepeated > 0) {
+			write(L"(last message repeated " + std::to_wstring(mRepeated) + L" times)");
+			mRepeated = 0;
+		}
+	}
+
+	void process(const LogMessage& m) {
+		if (m.level == mLast.level && m.text == mLast.text) {
+			mRepeated++;
+			return;
+		}
+		writeRepeated();
+		mLast = m;
+
+		if (m.level < prt::LOG_ERROR) {
+			const Clock::time_point now = Clock::now();
+			if (now - mWindowStart >= std::chrono::seconds(1)) {
+				if (mSuppressed > 0)
+					write(L"(suppressed " + std::to_wstring(mSuppressed) + L" messages)");
+				mWindowStart = now;
+				mWindowCount = 0;
+				mSuppressed = 0;
+			}
+			if (mWindowCount++ >= LOG_RATE_LIMIT) {
+				mSuppressed++;
+				return;
+			}
+		}
+		write(m.text);
+	}
+
+	// returns true if any message was processed
+	bool drain() {
+		bool any = false;
+		LogMessage m;
+		while (mBuffer.pop(m)) {
+			process(m);
+			any = true;
+		}
+		std::deque<LogMessage> overflow;
+		{
+			std::lock_guard<std::mutex> lock(mOverflowMutex);
+			overflow.swap(mOverflow);
+		}
+		for (const LogMessage& om: overflow) {
+			process(om);
+			any = true;
+		}
+		const size_t dropped = mDropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0)
+			write(L"(dropped " + std::to_wstring(dropped) + L" messages, log buffer full)");
+		return any;
+	}
+
+	void run() {
+		while (true) {
+			const bool any = drain();
+			if (!any)
+				writeRepeated(); // idle, i.e. the repetition has ended
+			flush();
+
+			std::unique_lock<std::mutex> lock(mWaitMutex);
+			if (mStop)
+				break;
+			mWaitCondition.wait_for(lock, LOG_DRAIN_INTERVAL);
+		}
+
+		drain(); // messages enqueued while stopping
+		writeRepeated();
+		if (mSuppressed > 0)
+			write(L"(suppressed " + std::to_wstring(mSuppressed) + L" messages)");
+		flush();
+	}
+
+	const std::wstring      mName;
+	LogRingBuffer           mBuffer;
+	std::atomic<size_t>     mDropped{0};
+	std::mutex              mOverflowMutex; // errors which did not fit into the buffer
+	std::deque<LogMessage>  mOverflow;
+	std::string             mFilePath;
+	std::ofstream           mFile;
+
+	// consumer thread state
+	LogMessage              mLast;
+	size_t                  mRepeated    = 0;
+	Clock::time_point       mWindowStart = Clock::now();
+	size_t                  mWindowCount = 0;
+	size_t                  mSuppressed  = 0;
+
+	std::mutex              mWaitMutex;
+	std::condition_variable mWaitCondition;
+	bool                    mStop = false;
+	std::thread             mThread;
+};
+
+LogHandler::LogHandler(const std::wstring& name) : mSink(new LogSink(name)) { }
+
+LogHandler::~LogHandler() = default;
+
+void LogHandler::handleLogEvent(const wchar_t* msg, prt::LogLevel level) {
+	mSink->push(msg, level);
+}
+
+} // namespace logging
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "PalladioMain.h"
+
 #include "prt/API.h"
 #include "prt/LogHandler.h"
 
@@ -28,8 +30,34 @@
 #include <memory>
 
 
+/**
+ * Messages below PLD_LOG_LEVEL_MIN (a prt::LogLevel value) are compiled out, e.g. build with PLD_LOG_LEVEL_MIN=2 to
+ * remove all debug logging. Messages below the active log level (see setLogLevel) are not formatted at all.
+ */
+#ifndef PLD_LOG_LEVEL_MIN
+#	define PLD_LOG_LEVEL_MIN 1 // prt::LOG_DEBUG
+#endif
+
+
 namespace logging {
 
+// log level from the CITYENGINE_LOG_LEVEL environment variable (defaults to error)
+prt::LogLevel getLogLevelFromEnvironment();
+
+// the active log level applies to both our own and PRT's log messages
+PLD_TEST_EXPORTS_API prt::LogLevel getLogLevel();
+PLD_TEST_EXPORTS_API void setLogLevel(prt::LogLevel level);
+
+template<prt::LogLevel L>
+inline bool isEnabled() {
+	return (L >= PLD_LOG_LEVEL_MIN) && (L >= getLogLevel()); // left hand side is constant, getLogLevel() is skipped if it fails
+}
+
+// swallows the logger expression in the disabled branch of the log macros below
+struct LogVoidify {
+	template<typename T> void operator&(const T&) const { }
+};
+
 struct Logger { };
 
 const std::string LEVELS[] = { "trace", "debug", "info", "warning", "error", "fatal" };
@@ -67,15 +95,20 @@ template<prt::LogLevel L> struct PRTLogger : Logger {
 	std::wostringstream wstr;
 };
 
+class LogSink;
+
+/**
+ * Asynchronous log handler: PRT (worker) threads only enqueue messages into a lock-free ring buffer, a background
+ * thread writes them to the console or to the file given by PALLADIO_LOG_FILE (UTF-8). Repeated messages are collapsed
+ * and the output rate is limited. Messages are dropped if the buffer is full, except errors: they are never suppressed
+ * and go to a (locked) overflow queue instead.
+ */
 class LogHandler : public prt::LogHandler {
 public:
-	LogHandler(const std::wstring& name) : mName(name) {
-	}
+	explicit LogHandler(const std::wstring& name);
+	virtual ~LogHandler(); // writes out all pending messages
 
-	virtual void handleLogEvent(const wchar_t* msg, prt::LogLevel level) override {
-		// probably not the best idea - is there a houdini logging framework?
-		std::wcout << L"[" << mName << L"] " << msg << std::endl;
-	}
+	virtual void handleLogEvent(const wchar_t* msg, prt::LogLevel level) override;
 
 	virtual const prt::LogLevel* getLevels(size_t* count) override {
 		*count = prt::LogHandler::ALL_COUNT;
@@ -83,16 +116,12 @@ public:
 	}
 
 	virtual void getFormat(bool* dateTime, bool* level) override {
-		*dateTime = true;
+		*dateTime = false; // added by the sink, else repeated messages would never be identical
 		*level = true;
 	}
 
-	void setName(const std::wstring& n) {
-		mName = n;
-	}
-
 private:
-	std::wstring mName;
+	std::unique_ptr<LogSink> mSink;
 };
 
 using LogHandlerPtr = std::unique_ptr<LogHandler>;
@@ -110,8 +139,10 @@ using _LOG_ERR = LT<prt::LOG_ERROR>;
 using _LOG_FTL = LT<prt::LOG_FATAL>;
 
 // convenience shortcuts in global namespace
-#define LOG_DBG _LOG_DBG() << __FUNCTION__ << ": "
-#define LOG_INF _LOG_INF()
-#define LOG_WRN _LOG_WRN()
-#define LOG_ERR _LOG_ERR()
-#define LOG_FTL _LOG_FTL()
+// the streamed arguments are only evaluated if the level is enabled, i.e. disabled messages cost one level check
+#define PLD_LOG_IF(L, T) !logging::isEnabled<L>() ? (void)0 : logging::LogVoidify() & T()
+#define LOG_DBG PLD_LOG_IF(prt::LOG_DEBUG,   _LOG_DBG) << __FUNCTION__ << ": "
+#define LOG_INF PLD_LOG_IF(prt::LOG_INFO,    _LOG_INF)
+#define LOG_WRN PLD_LOG_IF(prt::LOG_WARNING, _LOG_WRN)
+#define LOG_ERR PLD_LOG_IF(prt::LOG_ERROR,   _LOG_ERR)
+#define LOG_FTL PLD_LOG_IF(prt::LOG_FATAL,   _LOG_FTL)
@@ -18,13 +18,14 @@
 #include "AttributeConversion.h"
 #include "ShapeConverter.h"
 #include "LogHandler.h"
-#include "MultiWatch.h"
+#include "Tracer.h"
 
 #include "GU/GU_HoleInfo.h"
 
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/variant.hpp)
 
+#include <chrono>
 #include <mutex>
 
 
@@ -32,6 +33,14 @@ namespace {
 
 constexpr bool DBG = false;
 
+constexpr size_t MAX_DISTINCT_MESSAGES = 100;
+
+const UT_String PLD_STATS_ENCODE_TIME    = "pldStatsEncodeTime";
+const UT_String PLD_STATS_CONVERT_TIME   = "pldStatsConvertTime";
+const UT_String PLD_STATS_LEAF_SHAPES    = "pldStatsLeafShapes";
+const UT_String PLD_STATS_FACES          = "pldStatsFaces";
+const UT_String PLD_STATS_GEOMETRY_BYTES = "pldStatsGeometryBytes";
+
 using UTVector3FVector = std::vector<UT_Vector3F>;
 
 UTVector3FVector convertVertices(const double* vtx, size_t vtxSize) {
@@ -64,6 +73,14 @@ void setVertexNormals(
 
 std::mutex mDetailMutex; // guard the houdini detail object
 
+template<typename H, typename T>
+void setPrimitiveValues(H&& handle, GA_Offset start, GA_Size size, const T& value) {
+	if (handle.isInvalid())
+		return;
+	for (GA_Offset off = start; off < start + size; ++off)
+		handle.set(off, value);
+}
+
 } // namespace
 
 
@@ -154,8 +171,10 @@ GA_Offset createPrimitives(GU_Detail* mDetail, GroupCreation gc, const wchar_t*
 } // namespace ModelConversion
 
 
-ModelConverter::ModelConverter(GU_Detail* detail, GroupCreation gc, std::vector<prt::Status>& statuses, UT_AutoInterrupt* autoInterrupt)
-: mDetail(detail), mGroupCreation(gc), mStatuses(statuses), mAutoInterrupt(autoInterrupt) { }
+ModelConverter::ModelConverter(GU_Detail* detail, GroupCreation gc, std::vector<prt::Status>& statuses,
+                               UT_AutoInterrupt* autoInterrupt, const AttributeConversion::AttributeStorage& attributeStorage)
+: mDetail(detail), mGroupCreation(gc), mStatuses(statuses), mAutoInterrupt(autoInterrupt),
+  mAttributeStorage(attributeStorage) { }
 
 void ModelConverter::add(
 		const wchar_t* name,
@@ -174,6 +193,7 @@ void ModelConverter::add(
 {
 	// we need to protect mDetail, it is accessed by multiple generate threads
 	std::lock_guard<std::mutex> guard(mDetailMutex);
+	const auto convertStart = std::chrono::steady_clock::now();
 
 	const GA_Offset primStartOffset = ModelConversion::createPrimitives(mDetail, mGroupCreation, name,
 	                                                                    vtx, vtxSize, nrm, nrmSize,
@@ -188,7 +208,8 @@ void ModelConverter::add(
 	if (faceRangesSize > 1) {
 		WA("add materials/reports");
 
-		AttributeConversion::HandleMap handleMap;
+		// separate handle maps per attribute class, they are created with different storage options
+		AttributeConversion::HandleMap materialHandleMap, reportHandleMap, ruleAttrHandleMap;
 		const GA_IndexMap& primIndexMap = mDetail->getIndexMap(GA_ATTRIB_PRIMITIVE);
 		for (size_t fri = 0; fri < faceRangesSize-1; fri++) {
 			const GA_Offset rangeStart = primStartOffset + faceRanges[fri];
@@ -196,16 +217,16 @@ void ModelConverter::add(
 
 			if (materials != nullptr) {
 				const prt::AttributeMap* attrMap = materials[fri];
-				AttributeConversion::extractAttributeNames(handleMap, attrMap);
-				AttributeConversion::createAttributeHandles(mDetail, handleMap);
-				AttributeConversion::setAttributeValues(handleMap, attrMap, primIndexMap, rangeStart, rangeSize);
+				AttributeConversion::extractAttributeNames(materialHandleMap, attrMap);
+				AttributeConversion::createAttributeHandles(mDetail, materialHandleMap, mAttributeStorage.materials);
+				AttributeConversion::setAttributeValues(materialHandleMap, attrMap, primIndexMap, rangeStart, rangeSize);
 			}
 
 			if (reports != nullptr) {
 				const prt::AttributeMap* attrMap = reports[fri];
-				AttributeConversion::extractAttributeNames(handleMap, attrMap);
-				AttributeConversion::createAttributeHandles(mDetail, handleMap);
-				AttributeConversion::setAttributeValues(handleMap, attrMap, primIndexMap, rangeStart, rangeSize);
+				AttributeConversion::extractAttributeNames(reportHandleMap, attrMap);
+				AttributeConversion::createAttributeHandles(mDetail, reportHandleMap, mAttributeStorage.reports);
+				AttributeConversion::setAttributeValues(reportHandleMap, attrMap, primIndexMap, rangeStart, rangeSize);
 			}
 
 			if (!mShapeAttributeBuilders.empty()) {
@@ -214,29 +235,71 @@ void ModelConverter::add(
 				auto it = mShapeAttributeBuilders.find(shapeID);
 				if (it != mShapeAttributeBuilders.end()) {
 					const AttributeMapUPtr attrMap(it->second->createAttributeMap());
-					AttributeConversion::extractAttributeNames(handleMap, attrMap.get());
-					AttributeConversion::createAttributeHandles(mDetail, handleMap);
-					AttributeConversion::setAttributeValues(handleMap, attrMap.get(), primIndexMap,
+					AttributeConversion::extractAttributeNames(ruleAttrHandleMap, attrMap.get());
+					AttributeConversion::createAttributeHandles(mDetail, ruleAttrHandleMap, mAttributeStorage.ruleAttributes);
+					AttributeConversion::setAttributeValues(ruleAttrHandleMap, attrMap.get(), primIndexMap,
 					                                        rangeStart, rangeSize);
 				}
 			}
 		}
 	}
+
+	// -- optionally add the generation statistics of this initial shape to all its primitives
+	if (mPendingStatistics) {
+		const double convertTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - convertStart).count();
+		const GA_Size primCount = static_cast<GA_Size>(countsSize);
+
+		setPrimitiveValues(GA_RWHandleD(mDetail->addFloatTuple(GA_ATTRIB_PRIMITIVE, PLD_STATS_ENCODE_TIME, 1, GA_Defaults(0.0), nullptr, nullptr, GA_STORE_REAL64)),
+		                   primStartOffset, primCount, mPendingStatistics->encodeTime);
+		setPrimitiveValues(GA_RWHandleD(mDetail->addFloatTuple(GA_ATTRIB_PRIMITIVE, PLD_STATS_CONVERT_TIME, 1, GA_Defaults(0.0), nullptr, nullptr, GA_STORE_REAL64)),
+		                   primStartOffset, primCount, convertTime);
+		setPrimitiveValues(GA_RWHandleI(mDetail->addIntTuple(GA_ATTRIB_PRIMITIVE, PLD_STATS_LEAF_SHAPES, 1)),
+		                   primStartOffset, primCount, static_cast<int32>(mPendingStatistics->leafShapeCount));
+		setPrimitiveValues(GA_RWHandleI(mDetail->addIntTuple(GA_ATTRIB_PRIMITIVE, PLD_STATS_FACES, 1)),
+		                   primStartOffset, primCount, static_cast<int32>(mPendingStatistics->faceCount));
+		setPrimitiveValues(GA_RWHandleID(mDetail->addIntTuple(GA_ATTRIB_PRIMITIVE, PLD_STATS_GEOMETRY_BYTES, 1, GA_Defaults(0), nullptr, nullptr, GA_STORE_INT64)),
+		                   primStartOffset, primCount, static_cast<int64>(mPendingStatistics->geometryBytes));
+
+		mPendingStatistics.reset();
+	}
+}
+
+void ModelConverter::addStatistics(size_t isIndex, uint32_t leafShapeCount, uint32_t faceCount, size_t geometryBytes,
+                                   double encodeTime)
+{
+	// implicit contract (as for the attr* callbacks): called right before add for the same initial shape
+	mPendingStatistics.reset(new ShapeStatistics());
+	mPendingStatistics->leafShapeCount = leafShapeCount;
+	mPendingStatistics->faceCount      = faceCount;
+	mPendingStatistics->geometryBytes  = geometryBytes;
+	mPendingStatistics->encodeTime     = encodeTime;
+}
+
+void ModelConverter::addMessage(std::wstring&& message) {
+	// one converter per generate thread, no locking needed
+	auto it = mMessages.find(message);
+	if (it != mMessages.end())
+		it->second++;
+	else if (mMessages.size() < MAX_DISTINCT_MESSAGES)
+		mMessages.emplace(std::move(message), 1);
 }
 
 prt::Status ModelConverter::generateError(size_t isIndex, prt::Status status, const wchar_t* message) {
 	LOG_WRN << message; // generate error for one shape is not yet a reason to abort cooking
 	mStatuses[isIndex] = status;
+	addMessage(message);
 	return prt::STATUS_OK;
 }
 
 prt::Status ModelConverter::assetError(size_t isIndex, prt::CGAErrorLevel level, const wchar_t* key, const wchar_t* uri, const wchar_t* message) {
 	LOG_WRN << key << L": " << message;
+	addMessage(std::wstring(key) + L": " + message);
 	return prt::STATUS_OK;
 }
 
 prt::Status ModelConverter::cgaError(size_t isIndex, int32_t shapeID, prt::CGAErrorLevel level, int32_t methodId, int32_t pc, const wchar_t* message) {
 	LOG_WRN << message;
+	addMessage(message);
 	return prt::STATUS_OK;
 }
 
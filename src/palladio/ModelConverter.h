@@ -17,6 +17,7 @@
 #pragma once
 
 #include "PalladioMain.h"
+#include "AttributeConversion.h"
 #include "ShapeConverter.h"
 #include "Utils.h"
 #include "encoder/HoudiniCallbacks.h"
@@ -39,12 +40,24 @@
 #	pragma GCC diagnostic pop
 #endif
 
+#include <map>
 #include <string>
 #include <vector>
 
 
 namespace ModelConversion {
 
+// visible for benchmarks
+PLD_TEST_EXPORTS_API GA_Offset createPrimitives(GU_Detail* detail, GroupCreation gc, const wchar_t* name,
+                                                const double* vtx, size_t vtxSize,
+                                                const double* nrm, size_t nrmSize,
+                                                const uint32_t* counts, size_t countsSize,
+                                                const uint32_t* indices, size_t indicesSize,
+                                                double const* const* uvs, size_t const* uvsSizes,
+                                                uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+                                                uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+                                                uint32_t uvSets);
+
 PLD_TEST_EXPORTS_API void getUVSet(
 	std::vector<uint32_t>& uvIndicesPerSet,
 	const uint32_t* counts, size_t countsSize,
@@ -66,7 +79,13 @@ void setUVs(
 
 class ModelConverter : public HoudiniCallbacks {
 public:
-	explicit ModelConverter(GU_Detail* gdp, GroupCreation gc, std::vector<prt::Status>& statuses, UT_AutoInterrupt* autoInterrupt = nullptr);
+	explicit ModelConverter(GU_Detail* gdp, GroupCreation gc, std::vector<prt::Status>& statuses,
+	                        UT_AutoInterrupt* autoInterrupt = nullptr,
+	                        const AttributeConversion::AttributeStorage& attributeStorage = {});
+
+	// distinct generate, asset and CGA error messages with their number of occurrences (for the node warnings)
+	using MessageCounts = std::map<std::wstring, size_t>;
+	const MessageCounts& getMessages() const { return mMessages; }
 
 protected:
 	void add(
@@ -85,6 +104,9 @@ protected:
 			const int32_t* shapeIDs
 	) override;
 
+	void addStatistics(size_t isIndex, uint32_t leafShapeCount, uint32_t faceCount, size_t geometryBytes,
+	                   double encodeTime) override;
+
 	prt::Status generateError(size_t isIndex, prt::Status status, const wchar_t* message) override;
 	prt::Status assetError(size_t isIndex, prt::CGAErrorLevel level, const wchar_t* key, const wchar_t* uri, const wchar_t* message) override;
 	prt::Status cgaError(size_t isIndex, int32_t shapeID, prt::CGAErrorLevel level, int32_t methodId, int32_t pc, const wchar_t* message) override;
@@ -107,7 +129,20 @@ private:
     GroupCreation mGroupCreation;
 	std::vector<prt::Status>& mStatuses;
 	UT_AutoInterrupt* mAutoInterrupt;
+	AttributeConversion::AttributeStorage mAttributeStorage;
 	std::map<int32_t, AttributeMapBuilderUPtr> mShapeAttributeBuilders;
+	MessageCounts mMessages;
+
+	// set by addStatistics for the next call to add
+	struct ShapeStatistics {
+		uint32_t leafShapeCount = 0;
+		uint32_t faceCount      = 0;
+		size_t   geometryBytes  = 0;
+		double   encodeTime     = 0.0;
+	};
+	std::unique_ptr<ShapeStatistics> mPendingStatistics;
+
+	void addMessage(std::wstring&& message);
 };
 
 using ModelConverterUPtr = std::unique_ptr<ModelConverter>;
@@ -31,40 +31,6 @@
 
 namespace {
 
-constexpr const wchar_t* CGA_ANNOTATION_START_RULE = L"@StartRule";
-constexpr const size_t   CGA_NO_START_RULE_FOUND   = size_t(-1);
-
-using StringPairVector = std::vector<std::pair<std::string,std::string>>;
-bool compareSecond (const StringPairVector::value_type& a, const StringPairVector::value_type& b) {
-	return ( a.second < b.second );
-
-}
-
-/**
- * find start rule (first annotated start rule or just first rule as fallback)
- */
-std::wstring findStartRule(const RuleFileInfoUPtr& info) {
-	const size_t numRules = info->getNumRules();
-	assert(numRules > 0);
-
-	auto startRuleIdx = CGA_NO_START_RULE_FOUND;
-	for (size_t ri = 0; ri < numRules; ri++) {
-		const prt::RuleFileInfo::Entry *re = info->getRule(ri);
-		for (size_t ai = 0; ai < re->getNumAnnotations(); ai++) {
-			if (std::wcscmp(re->getAnnotation(ai)->getName(), CGA_ANNOTATION_START_RULE) == 0) {
-				startRuleIdx = ri;
-				break;
-			}
-		}
-	}
-
-	if (startRuleIdx == CGA_NO_START_RULE_FOUND)
-		startRuleIdx = 0; // use first rule as fallback
-
-	const prt::RuleFileInfo::Entry *re = info->getRule(startRuleIdx);
-	return { re->getName() };
-}
-
 constexpr const int NOT_CHANGED = 0;
 constexpr const int CHANGED     = 1;
 
@@ -84,6 +50,9 @@ int updateRPK(void* data, int, fpreal32 time, const PRM_Template*) {
 	node->evalString(utNextRPKStr, AssignNodeParams::RPK.getToken(), 0, time);
 	const PLD_BOOST_NS::filesystem::path nextRPK(utNextRPKStr.toStdString());
 
+	// the reload button must see changes on disk immediately
+	prtCtx->mResolveMapCache->requestValidation(nextRPK);
+
 	ResolveMapSPtr resolveMap = prtCtx->getResolveMap(nextRPK);
 	if (!resolveMap ) {
 		LOG_WRN << "invalid resolve map";
@@ -101,13 +70,12 @@ int updateRPK(void* data, int, fpreal32 time, const PRM_Template*) {
 	const std::wstring cgbURI = cgbs.front().second;
 	LOG_DBG << "cgbKey = " << cgbKey << ", " << "cgbURI = " << cgbURI;
 
-	prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
-	const RuleFileInfoUPtr ruleFileInfo(prt::createRuleFileInfo(cgbURI.c_str(), prtCtx->mPRTCache.get(), &status)); // TODO: cache
-	if (!ruleFileInfo || (status != prt::STATUS_OK) || (ruleFileInfo->getNumRules() == 0)) {
+	const RuleFileInfoCache::EntrySPtr ruleFileInfo = prtCtx->getRuleFileInfo(nextRPK, resolveMap, cgbKey);
+	if (!ruleFileInfo || ruleFileInfo->startRule.empty()) {
 		LOG_ERR << "failed to get rule file info or rule file does not contain any rules";
 		return NOT_CHANGED;
 	}
-	const std::wstring fqStartRule = findStartRule(ruleFileInfo);
+	const std::wstring& fqStartRule = ruleFileInfo->startRule;
 
 	// -- get style/name from start rule
 	auto getStartRuleComponents = [](const std::wstring& fqRule) -> std::pair<std::wstring,std::wstring> {
@@ -123,9 +91,6 @@ int updateRPK(void* data, int, fpreal32 time, const PRM_Template*) {
 	AssignNodeParams::setStyle(node, startRuleComponents.first, time);
 	AssignNodeParams::setStartRule(node, startRuleComponents.second, time);
 
-	// reset was successful, try to optimize the cache
-	prtCtx->mPRTCache->flushAll();
-
 	return CHANGED;
 }
 
@@ -163,40 +128,18 @@ void buildStartRuleMenu(void* data, PRM_Name* theMenu, int theMaxSize, const PRM
 		return;
 	}
 
-	prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
-	RuleFileInfoUPtr rfi(prt::createRuleFileInfo(cgbURI, nullptr, &status));
-	if (status == prt::STATUS_OK) {
-		StringPairVector startRules, rules;
-		for (size_t ri = 0; ri < rfi->getNumRules(); ri++) {
-			const prt::RuleFileInfo::Entry* re = rfi->getRule(ri);
-			const std::wstring wRuleName = NameConversion::removeStyle(re->getName());
-			const std::string rn = toOSNarrowFromUTF16(wRuleName);
-
-			bool hasStartRuleAnnotation = false;
-			for (size_t ai = 0; ai < re->getNumAnnotations(); ai++) {
-				if (std::wcscmp(re->getAnnotation(ai)->getName(), CGA_ANNOTATION_START_RULE) == 0) {
-					hasStartRuleAnnotation = true;
-					break;
-				}
-			}
-
-			if (hasStartRuleAnnotation)
-				startRules.emplace_back(rn, rn + " (@StartRule)");
-			else
-				rules.emplace_back(rn, rn);
-		}
-
-		std::sort(startRules.begin(), startRules.end(), compareSecond);
-		std::sort(rules.begin(), rules.end(), compareSecond);
-		rules.reserve(rules.size() + startRules.size());
-		rules.insert(rules.begin(), startRules.begin(), startRules.end());
-
-		const size_t limit = std::min<size_t>(rules.size(), static_cast<size_t>(theMaxSize));
-		for (size_t ri = 0; ri < limit; ri++) {
-			theMenu[ri].setTokenAndLabel(rules[ri].first.c_str(), rules[ri].second.c_str());
-		}
-		theMenu[limit].setTokenAndLabel(nullptr, nullptr); // need a null terminator
+	const RuleFileInfoCache::EntrySPtr rfi = prtCtx->getRuleFileInfo(rpk, resolveMap, ruleFile);
+	if (!rfi) {
+		theMenu[0].setTokenAndLabel(nullptr, nullptr);
+		return;
 	}
+
+	const auto& rules = rfi->startRuleMenu;
+	const size_t limit = std::min<size_t>(rules.size(), static_cast<size_t>(theMaxSize));
+	for (size_t ri = 0; ri < limit; ri++) {
+		theMenu[ri].setTokenAndLabel(rules[ri].first.c_str(), rules[ri].second.c_str());
+	}
+	theMenu[limit].setTokenAndLabel(nullptr, nullptr); // need a null terminator
 }
 
 void buildRuleFileMenu(void* data, PRM_Name* theMenu, int theMaxSize, const PRM_SpareData*, const PRM_Parm* parm) {
@@ -223,12 +166,6 @@ void buildRuleFileMenu(void* data, PRM_Name* theMenu, int theMaxSize, const PRM_
 	theMenu[limit].setTokenAndLabel(nullptr, nullptr); // need a null terminator
 }
 
-std::string extractStyle(const prt::RuleFileInfo::Entry* re) {
-	std::wstring style, name;
-	NameConversion::separate(re->getName(), style, name);
-	return toOSNarrowFromUTF16(style);
-}
-
 void buildStyleMenu(void* data, PRM_Name* theMenu, int theMaxSize, const PRM_SpareData*, const PRM_Parm*) {
 	const auto* node = static_cast<SOPAssign*>(data);
 	const PRTContextUPtr& prtCtx = node->getPRTCtx();
@@ -249,26 +186,18 @@ void buildStyleMenu(void* data, PRM_Name* theMenu, int theMaxSize, const PRM_Spa
 		return;
 	}
 
-	prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
-	RuleFileInfoUPtr rfi(prt::createRuleFileInfo(cgbURI, nullptr, &status));
-	if (rfi && (status == prt::STATUS_OK)) {
-		std::set<std::string> styles;
-		for (size_t ri = 0; ri < rfi->getNumRules(); ri++) {
-			const prt::RuleFileInfo::Entry* re = rfi->getRule(ri);
-			styles.emplace(extractStyle(re));
-		}
- 		for (size_t ai = 0; ai < rfi->getNumAttributes(); ai++) {
-			const prt::RuleFileInfo::Entry* re = rfi->getAttribute(ai);
-			styles.emplace(extractStyle(re));
-		}
-		size_t si = 0;
-		for (const auto& s : styles) {
-			theMenu[si].setTokenAndLabel(s.c_str(), s.c_str());
-			si++;
-		}
-		const size_t limit = std::min<size_t>(styles.size(), static_cast<size_t>(theMaxSize));
-		theMenu[limit].setTokenAndLabel(nullptr, nullptr); // need a null terminator
+	const RuleFileInfoCache::EntrySPtr rfi = prtCtx->getRuleFileInfo(rpk, resolveMap, ruleFile);
+	if (!rfi) {
+		theMenu[0].setTokenAndLabel(nullptr, nullptr);
+		return;
+	}
+
+	const auto& styles = rfi->styles;
+	const size_t limit = std::min<size_t>(styles.size(), static_cast<size_t>(theMaxSize));
+	for (size_t si = 0; si < limit; si++) {
+		theMenu[si].setTokenAndLabel(styles[si].c_str(), styles[si].c_str());
 	}
+	theMenu[limit].setTokenAndLabel(nullptr, nullptr); // need a null terminator
 }
 
 } // namespace AssignNodeParams
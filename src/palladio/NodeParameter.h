@@ -18,6 +18,7 @@
 
 #include "ShapeConverter.h"
 #include "PrimitiveClassifier.h"
+#include "AttributeConversion.h"
 #include "Utils.h"
 
 #include "PRM/PRM_ChoiceList.h"
@@ -32,6 +33,35 @@
 #include PLD_BOOST_INCLUDE(/filesystem/path.hpp)
 
 
+namespace AttributeStorageParams {
+
+// -- FLOAT PRECISION (shared by several attribute classes)
+static const char* FLOAT_PRECISION_TOKENS[] = { "SINGLE", "DOUBLE" };
+static const char* FLOAT_PRECISION_LABELS[] = {
+	"Single precision (32 bit)",
+	"Double precision (64 bit)"
+};
+static PRM_Name FLOAT_PRECISION_MENU_ITEMS[] = {
+	PRM_Name(FLOAT_PRECISION_TOKENS[0], FLOAT_PRECISION_LABELS[0]),
+	PRM_Name(FLOAT_PRECISION_TOKENS[1], FLOAT_PRECISION_LABELS[1]),
+	PRM_Name(nullptr)
+};
+static PRM_ChoiceList floatPrecisionMenu((PRM_ChoiceListType)(PRM_CHOICELIST_EXCLUSIVE | PRM_CHOICELIST_REPLACE), FLOAT_PRECISION_MENU_ITEMS);
+const size_t DEFAULT_FLOAT_PRECISION_ORDINAL = 0;
+static PRM_Default DEFAULT_FLOAT_PRECISION(0, FLOAT_PRECISION_TOKENS[DEFAULT_FLOAT_PRECISION_ORDINAL]);
+
+const auto getFloatPrecision = [](const OP_Node* node, const PRM_Name& parm, fpreal t) -> AttributeConversion::FloatPrecision {
+	const auto ord = node->evalInt(parm.getToken(), 0, t);
+	switch (ord) {
+		case 0: return AttributeConversion::FloatPrecision::SINGLE;
+		case 1: return AttributeConversion::FloatPrecision::DOUBLE;
+		default: return AttributeConversion::FloatPrecision::SINGLE;
+	}
+};
+
+} // namespace AttributeStorageParams
+
+
 namespace AssignNodeParams {
 
 // -- PRIMITIVE CLASSIFIER NAME
@@ -129,6 +159,29 @@ const auto setStartRule = [](OP_Node* node, const std::wstring& s, fpreal t) {
 };
 
 
+// -- RULE ATTRIBUTE FLOAT PRECISION
+static PRM_Name FLOAT_PRECISION("floatPrecision", "Float Attribute Precision");
+const std::string FLOAT_PRECISION_HELP = "Storage precision of float primitive attributes created for default rule attribute values";
+
+const auto getFloatPrecision = [](const OP_Node* node, fpreal t) -> AttributeConversion::FloatPrecision {
+	return AttributeStorageParams::getFloatPrecision(node, FLOAT_PRECISION, t);
+};
+
+
+// -- SHARE INVARIANT DEFAULTS
+static PRM_Name SHARE_INVARIANT_DEFAULTS("shareInvariantDefaults", "Share Geometry-Independent Defaults");
+const std::string SHARE_INVARIANT_DEFAULTS_HELP = "Detects default rule attributes whose values depend neither on the "
+                                                  "shape geometry nor on the random seed (by comparing them on a few probe "
+                                                  "shapes) and evaluates them only once per rule. Note: this is a heuristic, "
+                                                  "if an attribute depends on the shape in a way the probes do not reveal "
+                                                  "(e.g. a threshold on the shape area or height), all shapes silently get "
+                                                  "the value of the probes. Disable this option for such rules.";
+
+const auto getShareInvariantDefaults = [](const OP_Node* node, fpreal t) -> bool {
+	return (node->evalInt(SHARE_INVARIANT_DEFAULTS.getToken(), 0, t) > 0);
+};
+
+
 // -- ASSIGN NODE PARAMS
 static PRM_Template PARAM_TEMPLATES[] = {
 		PRM_Template(PRM_STRING,   1, &PRIM_CLS,   &PRIM_CLS_DEFAULT, nullptr,        nullptr, PRM_Callback(), nullptr,                             1, PRIM_CLS_HELP.c_str()),
@@ -137,6 +190,9 @@ static PRM_Template PARAM_TEMPLATES[] = {
 		PRM_Template(PRM_STRING,   1, &RULE_FILE,  PRMoneDefaults,    &ruleFileMenu,  nullptr, PRM_Callback(), nullptr,                             1, RULE_FILE_HELP.c_str()),
 		PRM_Template(PRM_STRING,   1, &STYLE,      PRMoneDefaults,    &styleMenu,     nullptr, PRM_Callback(), nullptr,                             1, STYLE_HELP.c_str()),
 		PRM_Template(PRM_STRING,   1, &START_RULE, PRMoneDefaults,    &startRuleMenu, nullptr, PRM_Callback(), nullptr,                             1, START_RULE_HELP.c_str()),
+		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &FLOAT_PRECISION, &AttributeStorageParams::DEFAULT_FLOAT_PRECISION,
+		             &AttributeStorageParams::floatPrecisionMenu, nullptr, PRM_Callback(), nullptr, 1, FLOAT_PRECISION_HELP.c_str()),
+		PRM_Template(PRM_TOGGLE,   1, &SHARE_INVARIANT_DEFAULTS, PRMzeroDefaults, nullptr, nullptr, PRM_Callback(), nullptr, 1, SHARE_INVARIANT_DEFAULTS_HELP.c_str()),
 		PRM_Template()
 };
 
@@ -172,11 +228,58 @@ const auto getGroupCreation = [](const OP_Node* node, fpreal t) -> GroupCreation
 static PRM_Name EMIT_ATTRS("emitAttrs", "Emit CGA attributes");
 static PRM_Name EMIT_MATERIAL("emitMaterials", "Emit material attributes");
 static PRM_Name EMIT_REPORTS("emitReports", "Emit CGA reports");
+static PRM_Name EMIT_STATISTICS("emitStatistics", "Emit generation statistics");
+
+static PRM_Name ATTRS_FLOAT_PRECISION("attrsFloatPrecision", "CGA attribute precision");
+static PRM_Name MATERIAL_FLOAT_PRECISION("materialsFloatPrecision", "Material attribute precision");
+static PRM_Name REPORTS_FLOAT_PRECISION("reportsFloatPrecision", "CGA report precision");
+
+static PRM_Name ARRAY_STORAGE("arrayStorage", "Array Attributes");
+static const char* ARRAY_STORAGE_TOKENS[] = { "TUPLE", "ARRAY" };
+static const char* ARRAY_STORAGE_LABELS[] = {
+	"Attribute tuples (one component per element)",
+	"Native array attributes"
+};
+static PRM_Name ARRAY_STORAGE_MENU_ITEMS[] = {
+	PRM_Name(ARRAY_STORAGE_TOKENS[0], ARRAY_STORAGE_LABELS[0]),
+	PRM_Name(ARRAY_STORAGE_TOKENS[1], ARRAY_STORAGE_LABELS[1]),
+	PRM_Name(nullptr)
+};
+static PRM_ChoiceList arrayStorageMenu((PRM_ChoiceListType)(PRM_CHOICELIST_EXCLUSIVE | PRM_CHOICELIST_REPLACE), ARRAY_STORAGE_MENU_ITEMS);
+const size_t DEFAULT_ARRAY_STORAGE_ORDINAL = 0;
+static PRM_Default DEFAULT_ARRAY_STORAGE(0, ARRAY_STORAGE_TOKENS[DEFAULT_ARRAY_STORAGE_ORDINAL]);
+
+const auto getArrayStorage = [](const OP_Node* node, fpreal t) -> AttributeConversion::ArrayStorage {
+	const auto ord = node->evalInt(ARRAY_STORAGE.getToken(), 0, t);
+	switch (ord) {
+		case 0: return AttributeConversion::ArrayStorage::TUPLE;
+		case 1: return AttributeConversion::ArrayStorage::ARRAY;
+		default: return AttributeConversion::ArrayStorage::TUPLE;
+	}
+};
+
+const auto getAttributeStorage = [](const OP_Node* node, fpreal t) -> AttributeConversion::AttributeStorage {
+	const auto arrayStorage = getArrayStorage(node, t);
+	AttributeConversion::AttributeStorage as;
+	as.ruleAttributes.floatPrecision = AttributeStorageParams::getFloatPrecision(node, ATTRS_FLOAT_PRECISION, t);
+	as.ruleAttributes.arrayStorage   = arrayStorage;
+	as.materials.floatPrecision      = AttributeStorageParams::getFloatPrecision(node, MATERIAL_FLOAT_PRECISION, t);
+	as.materials.arrayStorage        = arrayStorage;
+	as.reports.floatPrecision        = AttributeStorageParams::getFloatPrecision(node, REPORTS_FLOAT_PRECISION, t);
+	as.reports.arrayStorage          = arrayStorage;
+	return as;
+};
+
 static PRM_Template PARAM_TEMPLATES[] {
 		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &GROUP_CREATION, &DEFAULT_GROUP_CREATION, &groupCreationMenu),
 		PRM_Template(PRM_TOGGLE, 1, &EMIT_ATTRS),
+		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &ATTRS_FLOAT_PRECISION, &AttributeStorageParams::DEFAULT_FLOAT_PRECISION, &AttributeStorageParams::floatPrecisionMenu),
 		PRM_Template(PRM_TOGGLE, 1, &EMIT_MATERIAL),
+		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &MATERIAL_FLOAT_PRECISION, &AttributeStorageParams::DEFAULT_FLOAT_PRECISION, &AttributeStorageParams::floatPrecisionMenu),
 		PRM_Template(PRM_TOGGLE, 1, &EMIT_REPORTS),
+		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &REPORTS_FLOAT_PRECISION, &AttributeStorageParams::DEFAULT_FLOAT_PRECISION, &AttributeStorageParams::floatPrecisionMenu),
+		PRM_Template(PRM_TOGGLE, 1, &EMIT_STATISTICS),
+		PRM_Template(PRM_ORD, PRM_Template::PRM_EXPORT_MAX, 1, &ARRAY_STORAGE, &DEFAULT_ARRAY_STORAGE, &arrayStorageMenu),
 		PRM_Template()
 };
 
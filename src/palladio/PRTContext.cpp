@@ -15,8 +15,10 @@
  */
 
 #include "PRTContext.h"
+#include "AttributeConversion.h"
 #include "PalladioMain.h"
 #include "LogHandler.h"
+#include "Tracer.h"
 #include "SOPAssign.h"
 
 #if PRT_VERSION_MAJOR < 2
@@ -27,6 +29,15 @@
 #include "OP/OP_Director.h"
 #include "OP/OP_Network.h"
 
+#include "UT/UT_ParallelUtil.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <cwchar>
+#include <fstream>
+#include <deque>
+#include <functional>
 #include <thread>
 #include <mutex>
 
@@ -37,11 +48,11 @@ constexpr const wchar_t*      PLD_LOG_PREFIX          = L"pld";
 constexpr const char*         PLD_TMP_PREFIX          = "palladio_";
 
 constexpr const char*         PRT_LIB_SUBDIR          = "prtlib";
-
-constexpr const prt::LogLevel PRT_LOG_LEVEL_DEFAULT   = prt::LOG_ERROR;
-constexpr const char*         PRT_LOG_LEVEL_ENV_VAR   = "CITYENGINE_LOG_LEVEL";
-constexpr const char*         PRT_LOG_LEVEL_STRINGS[] = { "trace", "debug", "info", "warning", "error", "fatal" };
-constexpr const size_t        PRT_LOG_LEVEL_STRINGS_N = sizeof(PRT_LOG_LEVEL_STRINGS)/sizeof(PRT_LOG_LEVEL_STRINGS[0]);
+constexpr size_t              RPK_UNPACK_THREADS      = 2;
+constexpr size_t              RPK_WARMUP_THREADS      = 1; // one rule package at a time, its files are processed in parallel
+constexpr const char*         RPK_WARMUP_ENV_VAR      = "PALLADIO_RPK_WARMUP";
+constexpr const char*         TRACE_FILE_ENV_VAR      = "PALLADIO_TRACE_FILE";
+constexpr size_t              WARMUP_READ_BUFFER_SIZE = 1 << 20;
 
 #if PRT_VERSION_MAJOR < 2
 
@@ -84,17 +95,6 @@ public:
 
 #endif // PRT_VERSION_MAJOR < 2
 
-// TODO: move to LogHandler
-prt::LogLevel getLogLevel() {
-	const char* e = std::getenv(PRT_LOG_LEVEL_ENV_VAR);
-	if (e == nullptr || strlen(e) == 0)
-		return PRT_LOG_LEVEL_DEFAULT;
-	for (size_t i = 0; i < PRT_LOG_LEVEL_STRINGS_N; i++)
-		if (strcmp(e, PRT_LOG_LEVEL_STRINGS[i]) == 0)
-			return static_cast<prt::LogLevel>(i);
-	return PRT_LOG_LEVEL_DEFAULT;
-}
-
 template<typename C>
 std::vector<const C*> toPtrVec(const std::vector<std::basic_string<C>>& sv) {
 	std::vector<const C*> pv(sv.size());
@@ -132,24 +132,140 @@ void scheduleRecook(const PLD_BOOST_NS::filesystem::path& rpk) {
 PLD_BOOST_NS::filesystem::path getProcessTempDir() {
 	PLD_BOOST_NS::system::error_code ec;
 	auto tp = PLD_BOOST_NS::filesystem::temp_directory_path(ec);
-	if (!ec)
+	if (ec)
 		tp = "/tmp/"; // TODO: other OSes
 	std::string n = std::string(PLD_TMP_PREFIX) + std::to_string(::getpid());
-	return { "/tmp/" + n };
+	return tp / n;
+}
+
+/**
+ * remove the cached CGBs, textures, assets etc of a (replaced) rule package from the PRT cache
+ * and leave the entries of all other rule packages alone
+ */
+void flushResolveMapEntries(prt::Cache* cache, const ResolveMapSPtr& resolveMap) {
+	size_t numKeys = 0;
+	const wchar_t* const* keys = resolveMap->getKeys(&numKeys);
+	for (size_t k = 0; k < numKeys; k++) {
+		const wchar_t* uri = resolveMap->getString(keys[k]);
+		if (uri != nullptr)
+			cache->flushEntry(uri);
+	}
+	LOG_DBG << "flushed " << numKeys << " PRT cache entries of stale resolve map";
+}
+
+bool isWarmupEnabled() {
+	const char* e = std::getenv(RPK_WARMUP_ENV_VAR);
+	return (e != nullptr) && (std::strcmp(e, "1") == 0);
+}
+
+PLD_BOOST_NS::filesystem::path getTraceFile() {
+	const char* e = std::getenv(TRACE_FILE_ENV_VAR);
+	return (e != nullptr) ? PLD_BOOST_NS::filesystem::path(e) : PLD_BOOST_NS::filesystem::path();
+}
+
+// only handles the file URIs created by PRT for unpacked rule packages
+bool fromFileURI(const std::wstring& uri, PLD_BOOST_NS::filesystem::path& p) {
+	constexpr const wchar_t* FILE_SCHEMA = L"file:";
+	if (uri.compare(0, std::wcslen(FILE_SCHEMA), FILE_SCHEMA) != 0)
+		return false;
+
+	std::string utf8Path;
+	const std::string u = toOSNarrowFromUTF16(uri.substr(std::wcslen(FILE_SCHEMA)));
+	for (size_t i = 0; i < u.size(); i++) {
+		if (u[i] == '%' && i + 2 < u.size()) {
+			const char hex[3] = { u[i + 1], u[i + 2], 0 };
+			utf8Path.push_back(static_cast<char>(std::strtol(hex, nullptr, 16)));
+			i += 2;
+		}
+		else
+			utf8Path.push_back(u[i]);
+	}
+
+#ifdef _WIN32
+	if (utf8Path.size() > 2 && utf8Path[0] == '/' && utf8Path[2] == ':') // file:/c:/...
+		utf8Path.erase(0, 1);
+#endif
+
+	p = utf8Path;
+	return true;
 }
 
 } // namespace
 
 
+/**
+ * minimal thread pool to run tasks in the background, pending tasks are discarded on destruction
+ */
+class BackgroundWorker {
+public:
+	using Task = std::function<void()>;
+
+	explicit BackgroundWorker(size_t numThreads) {
+		for (size_t i = 0; i < numThreads; i++)
+			mThreads.emplace_back([this]() { run(); });
+	}
+
+	~BackgroundWorker() {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+			mTasks.clear();
+		}
+		mCondition.notify_all();
+		for (auto& t: mThreads)
+			t.join();
+	}
+
+	void post(Task&& task) {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mTasks.emplace_back(std::move(task));
+		}
+		mCondition.notify_one();
+	}
+
+private:
+	void run() {
+		while (true) {
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this]() { return mStop || !mTasks.empty(); });
+				if (mStop)
+					return;
+				task = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::mutex               mMutex;
+	std::condition_variable  mCondition;
+	std::deque<Task>         mTasks;
+	std::vector<std::thread> mThreads;
+	bool                     mStop = false;
+};
+
+
 PRTContext::PRTContext(const std::vector<PLD_BOOST_NS::filesystem::path>& addExtDirs)
         : mLogHandler(new logging::LogHandler(PLD_LOG_PREFIX)),
           mPRTHandle{nullptr},
           mPRTCache{prt::CacheObject::create(prt::CacheObject::CACHE_TYPE_DEFAULT)},
           mCores{getNumCores()},
-          mResolveMapCache{new ResolveMapCache(getProcessTempDir())}
+          mResolveMapCache{new ResolveMapCache(getProcessTempDir())},
+          mRuleFileInfoCache{new RuleFileInfoCache()},
+          mDefaultAttributeCache{new DefaultAttributeCache()},
+          mBackgroundWorker{new BackgroundWorker(RPK_UNPACK_THREADS)},
+          mWarmup{isWarmupEnabled()},
+          mWarmupWorker{mWarmup ? new BackgroundWorker(RPK_WARMUP_THREADS) : nullptr},
+          mTraceFile{getTraceFile()}
 {
-    const prt::LogLevel logLevel = getLogLevel();
-	prt::setLogLevel(logLevel);
+	if (!mTraceFile.empty())
+		tracing::setEnabled(true);
+
+    const prt::LogLevel logLevel = logging::getLogLevelFromEnvironment();
+	logging::setLogLevel(logLevel);
 	prt::addLogHandler(mLogHandler.get());
 
 	// -- get the dir containing prt core library
@@ -199,6 +315,14 @@ PRTContext::PRTContext(const std::vector<PLD_BOOST_NS::filesystem::path>& addExt
 }
 
 PRTContext::~PRTContext() {
+	mWarmupWorker.reset(); // waits for a running warmup, must finish before any cache is released
+	mBackgroundWorker.reset(); // waits for running unpack tasks, must finish before any cache is released
+
+	mDefaultAttributeCache.reset(); // holds PRT attribute maps, must be released before PRT shutdown
+	mRuleFileInfoCache.reset(); // same here for the rule file infos
+
+	AttributeConversion::logConversionCacheStats();
+
     mResolveMapCache.reset();
 	LOG_INF << "Released RPK Cache";
 
@@ -208,20 +332,156 @@ PRTContext::~PRTContext() {
 	mPRTHandle.reset(); // same here
 	LOG_INF << "Shutdown PRT & returned license";
 
+	if (!mTraceFile.empty()) {
+		tracing::setEnabled(false);
+		writeTrace();
+		LOG_INF << "Wrote trace to " << mTraceFile;
+	}
+
     prt::removeLogHandler(mLogHandler.get());
 }
 
-namespace {
-	std::mutex mResolveMapCacheMutex;
+void PRTContext::writeTrace() {
+	if (mTraceFile.empty())
+		return;
+
+	// only appends the events since the previous call, the first call starts a new file with the opening bracket
+	std::lock_guard<std::mutex> lock(mTraceFileMutex);
+	const std::ios::openmode mode = mTraceFileStarted ? std::ios::app : std::ios::trunc;
+	std::ofstream out(mTraceFile.string(), std::ios::out | mode);
+	if (!out) {
+		LOG_ERR << "Could not write trace to " << mTraceFile;
+		return;
+	}
+	if (!mTraceFileStarted) {
+		out << "[\n";
+		mTraceFileStarted = true;
+	}
+	tracing::writeChromeTraceEvents(out);
 }
 
 ResolveMapSPtr PRTContext::getResolveMap(const PLD_BOOST_NS::filesystem::path& rpk) {
-	std::lock_guard<std::mutex> lock(mResolveMapCacheMutex);
+	ResolveMapSPtr resolveMap = lookupResolveMap(rpk, false);
+	recookPending();
+	return resolveMap;
+}
+
+void PRTContext::prefetchResolveMap(const PLD_BOOST_NS::filesystem::path& rpk) {
+	if (rpk.empty())
+		return;
+	mBackgroundWorker->post([this, rpk]() { lookupResolveMap(rpk, true); });
+}
 
-	auto lookupResult = mResolveMapCache->get(rpk.string());
+RuleFileInfoCache::EntrySPtr PRTContext::getRuleFileInfo(const PLD_BOOST_NS::filesystem::path& rpk,
+                                                         const ResolveMapSPtr& resolveMap, const std::wstring& ruleFile)
+{
+	if (!resolveMap->hasKey(ruleFile.c_str())) // workaround for bug in getString
+		return {};
+	const wchar_t* cgbURI = resolveMap->getString(ruleFile.c_str());
+	if (cgbURI == nullptr)
+		return {};
+
+	RuleFileInfoCache::EntrySPtr entry = mRuleFileInfoCache->find(cgbURI);
+	if (entry)
+		return entry;
+
+	// parsing also loads the CGB into the PRT cache, both caches must only be filled for the current resolve map
+	const std::string rpkKey = rpk.string();
+	const bool isCurrent = runIfCurrent(rpk, resolveMap, [this, &entry, &rpkKey, cgbURI]() {
+		entry = mRuleFileInfoCache->get(rpkKey, cgbURI, mPRTCache.get());
+	});
+	if (!isCurrent) // a cook still uses the stale resolve map of a reloaded rule package
+		entry = RuleFileInfoCache::create(cgbURI, nullptr);
+	return entry;
+}
+
+ResolveMapSPtr PRTContext::lookupResolveMap(const PLD_BOOST_NS::filesystem::path& rpk, bool deferRecook) {
+	const std::string rpkKey = rpk.string();
+	auto lookupResult = mResolveMapCache->get(rpk, [this, &rpkKey](const ResolveMapSPtr& staleResolveMap) {
+		UT_AutoWriteLock reloadLock(mReloadLock); // waits for cache inserts of the stale resolve map, see runIfCurrent
+		if (staleResolveMap)
+			flushResolveMapEntries(mPRTCache.get(), staleResolveMap);
+		mRuleFileInfoCache->invalidate(rpkKey);
+		mDefaultAttributeCache->invalidate(rpkKey);
+	});
 	if (lookupResult.second == ResolveMapCache::CacheStatus::MISS) {
-		mPRTCache->flushAll();
-		scheduleRecook(rpk);
+		if (deferRecook) {
+			std::lock_guard<std::mutex> lock(mPendingRecooksMutex);
+			mPendingRecooks.insert(rpk);
+		}
+		else
+			scheduleRecook(rpk);
+
+		if (mWarmup && lookupResult.first) {
+			const ResolveMapSPtr resolveMap = lookupResult.first;
+			mWarmupWorker->post([this, rpk, resolveMap]() { warmup(rpk, resolveMap); });
+		}
 	}
 	return lookupResult.first;
 }
+
+/**
+ * loads the rule files of a new rule package into the PRT cache (and the rule file info cache) and reads the unpacked
+ * assets once to have them in the OS file cache when the first generate decodes them. Stops as soon as the rule
+ * package has been reloaded, i.e. no entries of the stale resolve map are inserted after the reload invalidated them.
+ */
+void PRTContext::warmup(const PLD_BOOST_NS::filesystem::path& rpk, const ResolveMapSPtr& resolveMap) {
+	std::vector<std::pair<std::wstring, std::wstring>> cgbs; // key -> uri
+	getCGBs(resolveMap, cgbs);
+
+	std::vector<PLD_BOOST_NS::filesystem::path> assets;
+	size_t numKeys = 0;
+	const wchar_t* const* keys = resolveMap->getKeys(&numKeys);
+	for (size_t k = 0; k < numKeys; k++) {
+		const wchar_t* uri = resolveMap->getString(keys[k]);
+		PLD_BOOST_NS::filesystem::path asset;
+		if (uri != nullptr && fromFileURI(uri, asset) && asset.extension() != ".cgb")
+			assets.emplace_back(std::move(asset));
+	}
+
+	// set by the first task which sees the reload, the other tasks skip their remaining items
+	std::atomic<bool> isStale(false);
+
+	const std::string rpkKey = rpk.string();
+	UTparallelForEachNumber(cgbs.size(), [this, &rpk, &resolveMap, &cgbs, &rpkKey, &isStale](const UT_BlockedRange<size_t>& r) {
+		for (size_t i = r.begin(); i < r.end() && !isStale; ++i) {
+			const auto& cgb = cgbs[i];
+			const bool isCurrent = runIfCurrent(rpk, resolveMap, [this, &rpkKey, &cgb]() {
+				mRuleFileInfoCache->get(rpkKey, cgb.second.c_str(), mPRTCache.get());
+			});
+			if (!isCurrent)
+				isStale = true;
+		}
+	});
+
+	UTparallelForEachNumber(assets.size(), [this, &rpk, &resolveMap, &assets, &isStale](const UT_BlockedRange<size_t>& r) {
+		std::vector<char> buffer(WARMUP_READ_BUFFER_SIZE);
+		for (size_t i = r.begin(); i < r.end() && !isStale; ++i) {
+			if (!mResolveMapCache->isCurrent(rpk, resolveMap)) {
+				isStale = true;
+				break;
+			}
+			std::ifstream in(assets[i].string(), std::ifstream::binary);
+			while (in.read(buffer.data(), buffer.size())) { }
+		}
+	});
+
+	if (isStale) {
+		LOG_DBG << "stopped warmup of reloaded " << rpk;
+		return;
+	}
+
+	LOG_DBG << "warmed up " << rpk << ": " << cgbs.size() << " rule files, " << assets.size() << " assets";
+}
+
+void PRTContext::recookPending() {
+	std::set<PLD_BOOST_NS::filesystem::path> pendingRecooks;
+	{
+		std::lock_guard<std::mutex> lock(mPendingRecooksMutex);
+		if (mPendingRecooks.empty())
+			return;
+		pendingRecooks.swap(mPendingRecooks);
+	}
+	for (const auto& rpk: pendingRecooks)
+		scheduleRecook(rpk);
+}
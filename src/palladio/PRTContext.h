@@ -18,6 +18,8 @@
 
 #include "PalladioMain.h"
 #include "ResolveMapCache.h"
+#include "DefaultAttributeCache.h"
+#include "RuleFileInfoCache.h"
 #include "Utils.h"
 
 #include "prt/Object.h"
@@ -25,8 +27,14 @@
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/filesystem.hpp)
 
+#include "UT/UT_RWLock.h"
+
 #include <map>
+#include <mutex>
+#include <set>
+
 
+class BackgroundWorker;
 
 namespace logging {
 class LogHandler;
@@ -45,13 +53,63 @@ struct PLD_TEST_EXPORTS_API PRTContext final {
 	~PRTContext();
 
 	ResolveMapSPtr getResolveMap(const PLD_BOOST_NS::filesystem::path& rpk);
+	void prefetchResolveMap(const PLD_BOOST_NS::filesystem::path& rpk); // unpacks rpk in the background
+
+	// resolves the rule file of rpk and returns its rule file info (empty pointer on failure), cached if possible
+	RuleFileInfoCache::EntrySPtr getRuleFileInfo(const PLD_BOOST_NS::filesystem::path& rpk,
+	                                             const ResolveMapSPtr& resolveMap, const std::wstring& ruleFile);
 	bool isAlive() const { return mPRTHandle.operator bool(); }
+	void writeTrace(); // appends the events recorded since the previous call to PALLADIO_TRACE_FILE, if tracing is enabled
+
+	/**
+	 * runs insert (which fills caches with data derived from resolveMap) only if resolveMap is still the current
+	 * resolve map of rpk. A reload waits for running inserts before it invalidates the caches, i.e. nothing derived
+	 * from a stale resolve map remains cached. Returns false if insert was skipped.
+	 */
+	template<typename F>
+	bool runIfCurrent(const PLD_BOOST_NS::filesystem::path& rpk, const ResolveMapSPtr& resolveMap, F insert) {
+		UT_AutoReadLock reloadLock(mReloadLock);
+		if (!mResolveMapCache->isCurrent(rpk, resolveMap))
+			return false;
+		insert();
+		return true;
+	}
+
+	logging::LogHandlerPtr    mLogHandler;
+	ObjectUPtr                mPRTHandle;
+	CacheObjectUPtr           mPRTCache;
+	const uint32_t            mCores;
+	ResolveMapCacheUPtr       mResolveMapCache;
+	RuleFileInfoCacheUPtr     mRuleFileInfoCache;
+	DefaultAttributeCacheUPtr mDefaultAttributeCache;
 
-	logging::LogHandlerPtr  mLogHandler;
-	ObjectUPtr              mPRTHandle;
-	CacheObjectUPtr         mPRTCache;
-	const uint32_t          mCores;
-	ResolveMapCacheUPtr     mResolveMapCache;
+private:
+	ResolveMapSPtr lookupResolveMap(const PLD_BOOST_NS::filesystem::path& rpk, bool deferRecook);
+	void recookPending();
+	void warmup(const PLD_BOOST_NS::filesystem::path& rpk, const ResolveMapSPtr& resolveMap);
+
+	std::unique_ptr<BackgroundWorker>        mBackgroundWorker;
+	std::mutex                               mPendingRecooksMutex;
+	std::set<PLD_BOOST_NS::filesystem::path> mPendingRecooks; // recooks cannot be triggered from background threads
+	const bool                               mWarmup;         // PALLADIO_RPK_WARMUP=1, see warmup()
+	std::unique_ptr<BackgroundWorker>        mWarmupWorker;   // separate from the unpack tasks, only with mWarmup
+	UT_RWLock                                mReloadLock;     // shared by cache inserts, exclusive for reloads
+	const PLD_BOOST_NS::filesystem::path     mTraceFile;      // PALLADIO_TRACE_FILE, enables tracing (see Tracer.h)
+	std::mutex                               mTraceFileMutex;
+	bool                                     mTraceFileStarted = false; // guarded by mTraceFileMutex
 };
 
 using PRTContextUPtr = std::unique_ptr<PRTContext>;
+
+// updates the trace file at the end of a cook, i.e. a crash or kill of Houdini only loses the events of the last cook
+class TraceFileUpdate {
+public:
+	explicit TraceFileUpdate(const PRTContextUPtr& prtCtx) : mPRTCtx(prtCtx) { }
+	~TraceFileUpdate() { mPRTCtx->writeTrace(); }
+
+	TraceFileUpdate(const TraceFileUpdate&) = delete;
+	TraceFileUpdate& operator=(const TraceFileUpdate&) = delete;
+
+private:
+	const PRTContextUPtr& mPRTCtx;
+};
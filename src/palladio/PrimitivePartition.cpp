@@ -17,6 +17,15 @@
 #include "PrimitivePartition.h"
 #include "PrimitiveClassifier.h"
 #include "LogHandler.h"
+#include "Tracer.h"
+
+#include "GA/GA_SplittableRange.h"
+#include "UT/UT_ParallelUtil.h"
+#include "UT/UT_ThreadSpecificValue.h"
+
+#include <unordered_map>
+#include <set>
+#include <algorithm>
 
 
 namespace {
@@ -24,69 +33,134 @@ namespace {
 constexpr bool  DBG               = false;
 constexpr int32 INVALID_CLS_VALUE = -1;
 
-} // namespace
-
+// handles to the attribute referenced by a primitive classifier name, resolved once per name and thread
+struct ClassifierHandles {
+	GA_ROHandleI intHandle;
+	GA_ROHandleS stringHandle;
 
-PrimitivePartition::PrimitivePartition(const GA_Detail* detail, const PrimitiveClassifier& primCls) {
-	const GA_Primitive* prim = nullptr;
-	GA_FOR_ALL_PRIMITIVES(detail, prim) {
-		add(detail, primCls, prim);
-	}
-}
+	bool isValid() const { return intHandle.isValid() || stringHandle.isValid(); }
+};
 
-void PrimitivePartition::add(const GA_Detail* detail, const PrimitiveClassifier& primCls, const GA_Primitive* p) {
-	if (DBG) LOG_DBG << "      adding prim: " << detail->primitiveIndex(p->getMapOffset());
+struct ClassifierBuckets {
+	std::unordered_map<int32, PrimitivePartition::PrimitiveVector>            intBuckets;
+	std::unordered_map<UT_StringHolder, PrimitivePartition::PrimitiveVector>  stringBuckets;
+	std::unordered_map<UT_StringHolder, ClassifierHandles>                    handleCache;
+	std::set<UT_StringHolder>                                                 ignoredClassifiers;
+	bool                                                                      hasEmptyStringValues = false;
+};
 
-	PrimitiveClassifier updatedPrimCls;
-	primCls.updateFromPrimitive(updatedPrimCls, detail, p);
+const ClassifierHandles& getClassifierHandles(const GA_Detail* detail, ClassifierBuckets& buckets, const UT_StringHolder& clsName) {
+	auto it = buckets.handleCache.find(clsName);
+	if (it != buckets.handleCache.end())
+		return it->second;
 
-	// try to read primitive classifier attr handle
-	GA_ROAttributeRef primClsAttrRef;
-	if (updatedPrimCls.name.length() > 0) { // we have a valid primitive classifier attribute name
-		const GA_ROAttributeRef r(detail->findPrimitiveAttribute(updatedPrimCls.name));
+	ClassifierHandles ch;
+	if (clsName.isstring()) { // we have a valid primitive classifier attribute name
+		const GA_ROAttributeRef r(detail->findPrimitiveAttribute(clsName));
 		if (r.isValid()) {
 			const auto& sc = r->getStorageClass();
-			if (sc == GA_STORECLASS_STRING || sc == GA_STORECLASS_INT)
-				primClsAttrRef = r; // we found the primitive classifier attribute itself
+			if (sc == GA_STORECLASS_INT)
+				ch.intHandle.bind(r.get());
+			else if (sc == GA_STORECLASS_STRING)
+				ch.stringHandle.bind(r.get());
 			else
-				LOG_WRN << "Ignoring primitive classifier '" << r->getName() << "', it is neither of type string or int";
+				buckets.ignoredClassifiers.insert(clsName);
 		}
 	}
+	return buckets.handleCache.emplace(clsName, ch).first->second;
+}
+
+void classify(const GA_Detail* detail, const GA_ROHandleS& clsNameHandle, const UT_StringHolder& defaultClsName,
+              ClassifierBuckets& buckets, GA_Offset off)
+{
+	const GA_Primitive* p = detail->getPrimitive(off);
+	if (DBG) LOG_DBG << "      adding prim: " << detail->primitiveIndex(off);
+
+	// the primitive classifier name can be overridden per primitive
+	const UT_StringHolder& clsName = clsNameHandle.isValid() ? clsNameHandle.get(off) : defaultClsName;
+	const ClassifierHandles& ch = getClassifierHandles(detail, buckets, clsName);
 
 	// try to read actual attr value and classify primitive
-	if (primClsAttrRef.isInvalid()) {
-		mPrimitives[INVALID_CLS_VALUE].push_back(p);
+	if (!ch.isValid()) {
+		buckets.intBuckets[INVALID_CLS_VALUE].push_back(p);
 		if (DBG) LOG_DBG << "       missing cls name: adding prim to fallback shape!";
 	}
-	else if (primClsAttrRef.isInt()) {
-		const GA_ROHandleI av(primClsAttrRef);
-		if (av.isValid()) {
-			const int32 v = av.get(p->getMapOffset());
-			if (DBG) LOG_DBG << "        got int classifier value: " << v;
-			mPrimitives[v].push_back(p);
-		}
-		else {
-			if (DBG) LOG_DBG << "        int: invalid handle!";
-		}
+	else if (ch.intHandle.isValid()) {
+		const int32 v = ch.intHandle.get(off);
+		if (DBG) LOG_DBG << "        got int classifier value: " << v;
+		buckets.intBuckets[v].push_back(p);
 	}
-	else if (primClsAttrRef.isString()) {
-		const GA_ROHandleS av(primClsAttrRef);
-		if (av.isValid()) {
-			const char* v = av.get(p->getMapOffset());
-			if (v) {
-				if (DBG) LOG_DBG << "        got string classifier value: " << v;
-				mPrimitives[UT_String(v)].push_back(p);
-			}
-			else {
-				mPrimitives[INVALID_CLS_VALUE].push_back(p);
-				LOG_WRN << "primitive classifier attribute has empty string value -> fallback shape";
-			}
+	else {
+		const UT_StringHolder& v = ch.stringHandle.get(off);
+		if (v.isstring()) {
+			if (DBG) LOG_DBG << "        got string classifier value: " << v;
+			buckets.stringBuckets[v].push_back(p);
 		}
 		else {
-			if (DBG) LOG_DBG << "        string: invalid handle!";
+			buckets.intBuckets[INVALID_CLS_VALUE].push_back(p);
+			buckets.hasEmptyStringValues = true;
 		}
 	}
-	else {
-		if (DBG) LOG_DBG << "        wrong type!";
+}
+
+void append(PrimitivePartition::PrimitiveVector& dst, const PrimitivePartition::PrimitiveVector& src) {
+	dst.insert(dst.end(), src.begin(), src.end());
+}
+
+bool compareOffsets(const GA_Primitive* a, const GA_Primitive* b) {
+	return a->getMapOffset() < b->getMapOffset();
+}
+
+} // namespace
+
+
+PrimitivePartition::PrimitivePartition(const GA_Detail* detail, const PrimitiveClassifier& primCls) {
+	WA("all");
+
+	// resolve the per-primitive classifier name attribute only once
+	const GA_ROHandleS clsNameHandle(detail->findPrimitiveAttribute(PLD_PRIM_CLS_NAME));
+	const UT_StringHolder defaultClsName(primCls.name);
+
+	UT_ThreadSpecificValue<ClassifierBuckets> threadBuckets;
+	UTparallelFor(GA_SplittableRange(detail->getPrimitiveRange()), [&](const GA_SplittableRange& r) {
+		ClassifierBuckets& buckets = threadBuckets.get();
+		GA_Offset start, end;
+		for (GA_Iterator it(r); it.blockAdvance(start, end);) {
+			for (GA_Offset off = start; off < end; ++off)
+				classify(detail, clsNameHandle, defaultClsName, buckets, off);
+		}
+	});
+
+	// merge the per-thread buckets into the ordered partition map
+	bool hasEmptyStringValues = false;
+	std::set<UT_StringHolder> ignoredClassifiers;
+	for (auto it = threadBuckets.begin(); it != threadBuckets.end(); ++it) {
+		const ClassifierBuckets& buckets = it.get();
+		for (const auto& b: buckets.intBuckets)
+			append(mPrimitives[b.first], b.second);
+		for (const auto& b: buckets.stringBuckets)
+			append(mPrimitives[UT_String(UT_String::ALWAYS_DEEP, b.first)], b.second);
+		ignoredClassifiers.insert(buckets.ignoredClassifiers.begin(), buckets.ignoredClassifiers.end());
+		for (const auto& h: buckets.handleCache)
+			mClassifierNames.insert(h.first);
+		hasEmptyStringValues |= buckets.hasEmptyStringValues;
 	}
+
+	// restore primitive order within each partition (threads process pages in arbitrary order)
+	std::vector<PrimitiveVector*> partitions;
+	partitions.reserve(mPrimitives.size());
+	for (auto& p: mPrimitives)
+		partitions.push_back(&p.second);
+	UTparallelForEachNumber(partitions.size(), [&partitions](const UT_BlockedRange<size_t>& r) {
+		for (size_t i = r.begin(); i < r.end(); ++i) {
+			PrimitiveVector& pv = *partitions[i];
+			if (!std::is_sorted(pv.begin(), pv.end(), compareOffsets))
+				std::sort(pv.begin(), pv.end(), compareOffsets);
+		}
+	});
+
+	for (const auto& c: ignoredClassifiers)
+		LOG_WRN << "Ignoring primitive classifier '" << c << "', it is neither of type string or int";
+	if (hasEmptyStringValues)
+		LOG_WRN << "primitive classifier attribute has empty string value -> fallback shape";
 }
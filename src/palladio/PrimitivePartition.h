@@ -27,22 +27,32 @@
 
 #include <vector>
 #include <map>
+#include <set>
 
 
 class PrimitiveClassifier;
 
-class PrimitivePartition {
+class PLD_TEST_EXPORTS_API PrimitivePartition {
 public:
 	using ClassifierValueType = PLD_BOOST_NS::variant<UT_String, int32>;
 	using PrimitiveVector     = std::vector<const GA_Primitive*>;
 	using PartitionMap        = std::map<ClassifierValueType, PrimitiveVector>;
+	using ClassifierNames     = std::set<UT_StringHolder>;
 
-	PartitionMap mPrimitives;
+	PartitionMap    mPrimitives;
+	ClassifierNames mClassifierNames; // all primitive classifier (attribute) names encountered while partitioning
 
+	/**
+	 * Classifies all primitives of the detail in parallel (over primitive pages). Primitives
+	 * of each partition are ordered by offset, i.e. the result is identical to a serial pass.
+	 */
 	PrimitivePartition(const GA_Detail* detail, const PrimitiveClassifier& primCls);
-	void add(const GA_Detail* detail, const PrimitiveClassifier& primCls, const GA_Primitive* p);
 
 	const PartitionMap& get() const {
 		return mPrimitives;
 	}
+
+	const ClassifierNames& getClassifierNames() const {
+		return mClassifierNames;
+	}
 };
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RPKStore.h"
+#include "LogHandler.h"
+
+#include "prt/API.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/file.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+
+namespace {
+
+constexpr const char* RPK_STORE_ENV_VAR         = "PALLADIO_RPK_STORE";
+constexpr const char* RPK_STORE_SIZE_ENV_VAR    = "PALLADIO_RPK_STORE_SIZE_MB";
+constexpr uintmax_t   RPK_STORE_SIZE_DEFAULT_MB = 4096;
+constexpr uintmax_t   MB                        = 1024 * 1024;
+
+constexpr const char* ENTRY_UNPACK_DIR = "unpacked";
+constexpr const char* ENTRY_INDEX      = "resolvemap.utf8.idx"; // key/URI pairs of the resolve map
+constexpr const char* ENTRY_COMPLETE   = "complete";            // written last, modification time = last use
+constexpr const char* LOCK_SUFFIX      = ".lock";               // removed together with the evicted entry
+
+constexpr size_t      HASH_BUFFER_SIZE = 1 << 20;            // must be a multiple of 8
+constexpr int         MAX_ATTEMPTS     = 3;
+
+/**
+ * advisory inter-process file lock (flock / LockFileEx), released on destruction
+ */
+class FileLock {
+public:
+	explicit FileLock(const PLD_BOOST_NS::filesystem::path& p) : mPath(p) {
+#ifdef _WIN32
+		mHandle = CreateFileW(p.wstring().c_str(), GENERIC_READ | GENERIC_WRITE,
+		                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+		                      FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+		mFD = ::open(p.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+#endif
+	}
+
+	~FileLock() {
+		unlock();
+#ifdef _WIN32
+		if (isValid())
+			CloseHandle(mHandle);
+#else
+		if (isValid())
+			::close(mFD);
+#endif
+	}
+
+	FileLock(const FileLock&) = delete;
+	FileLock& operator=(const FileLock&) = delete;
+
+	bool isValid() const {
+#ifdef _WIN32
+		return mHandle != INVALID_HANDLE_VALUE;
+#else
+		return mFD >= 0;
+#endif
+	}
+
+	bool lock(bool exclusive, bool wait) {
+		if (!isValid())
+			return false;
+		unlock();
+#ifdef _WIN32
+		OVERLAPPED ov = {};
+		DWORD flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+		mIsLocked = (LockFileEx(mHandle, flags, 0, MAXDWORD, MAXDWORD, &ov) != 0);
+#else
+		int op = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+		int res;
+		do {
+			res = ::flock(mFD, op);
+		} while (res != 0 && errno == EINTR);
+		mIsLocked = (res == 0);
+#endif
+		return mIsLocked;
+	}
+
+	/**
+	 * checks if the locked file is still the one at our path, i.e. it has not been removed by an eviction while we
+	 * were waiting for the lock. On Windows, a file with pending deletion cannot be opened again, so this always holds.
+	 */
+	bool isCurrent() const {
+#ifdef _WIN32
+		return isValid();
+#else
+		struct stat fdStat, pathStat;
+		if (!isValid() || ::fstat(mFD, &fdStat) != 0 || ::stat(mPath.string().c_str(), &pathStat) != 0)
+			return false;
+		return (fdStat.st_dev == pathStat.st_dev && fdStat.st_ino == pathStat.st_ino);
+#endif
+	}
+
+	void unlock() {
+		if (!mIsLocked)
+			return;
+#ifdef _WIN32
+		OVERLAPPED ov = {};
+		UnlockFileEx(mHandle, 0, MAXDWORD, MAXDWORD, &ov);
+#else
+		::flock(mFD, LOCK_UN);
+#endif
+		mIsLocked = false;
+	}
+
+private:
+	const PLD_BOOST_NS::filesystem::path mPath;
+#ifdef _WIN32
+	HANDLE mHandle = INVALID_HANDLE_VALUE;
+#else
+	int    mFD     = -1;
+#endif
+	bool   mIsLocked = false;
+};
+using FileLockSPtr = std::shared_ptr<FileLock>;
+
+uintmax_t getMaxSizeFromEnvironment() {
+	const char* e = std::getenv(RPK_STORE_SIZE_ENV_VAR);
+	if (e == nullptr || std::strlen(e) == 0)
+		return RPK_STORE_SIZE_DEFAULT_MB * MB;
+	const unsigned long long mb = std::strtoull(e, nullptr, 10);
+	return (mb > 0) ? static_cast<uintmax_t>(mb) * MB : RPK_STORE_SIZE_DEFAULT_MB * MB;
+}
+
+bool isComplete(const PLD_BOOST_NS::filesystem::path& entryDir) {
+	PLD_BOOST_NS::system::error_code ec;
+	return PLD_BOOST_NS::filesystem::exists(entryDir / ENTRY_COMPLETE, ec);
+}
+
+// entries of older versions have an index in a different encoding, they are unpacked again
+bool hasIndex(const PLD_BOOST_NS::filesystem::path& entryDir) {
+	PLD_BOOST_NS::system::error_code ec;
+	return PLD_BOOST_NS::filesystem::exists(entryDir / ENTRY_INDEX, ec);
+}
+
+void touch(const PLD_BOOST_NS::filesystem::path& p) {
+	PLD_BOOST_NS::system::error_code ec;
+	PLD_BOOST_NS::filesystem::last_write_time(p, std::time(nullptr), ec);
+}
+
+uintmax_t getDirectorySize(const PLD_BOOST_NS::filesystem::path& dir) {
+	uintmax_t size = 0;
+	PLD_BOOST_NS::system::error_code ec;
+	for (PLD_BOOST_NS::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (PLD_BOOST_NS::filesystem::is_regular_file(it->path(), ec))
+			size += PLD_BOOST_NS::filesystem::file_size(it->path(), ec);
+	}
+	return size;
+}
+
+// entries are stored as two UTF-8 lines per key/URI pair (neither contains line breaks)
+bool writeIndex(const PLD_BOOST_NS::filesystem::path& p, const prt::ResolveMap* resolveMap) {
+	std::ofstream out(p.string(), std::ofstream::binary);
+	size_t numKeys = 0;
+	const wchar_t* const* keys = resolveMap->getKeys(&numKeys);
+	for (size_t k = 0; k < numKeys; k++) {
+		const wchar_t* uri = resolveMap->getString(keys[k]);
+		if (uri == nullptr)
+			continue;
+		out << toUTF8FromUTF16(keys[k]) << '\n' << toUTF8FromUTF16(uri) << '\n';
+	}
+	out.close();
+	return !out.fail();
+}
+
+ResolveMapUPtr readIndex(const PLD_BOOST_NS::filesystem::path& p) {
+	std::ifstream in(p.string(), std::ifstream::binary);
+	if (!in)
+		return {};
+
+	ResolveMapBuilderUPtr rmb(prt::ResolveMapBuilder::create());
+	std::string key, uri;
+	while (std::getline(in, key) && std::getline(in, uri)) {
+		const std::wstring k = toUTF16FromUTF8(key);
+		const std::wstring u = toUTF16FromUTF8(uri);
+		rmb->addEntry(k.c_str(), u.c_str());
+	}
+	return ResolveMapUPtr(rmb->createResolveMap());
+}
+
+ResolveMapSPtr withLease(ResolveMapUPtr&& resolveMap, const FileLockSPtr& lease) {
+	return ResolveMapSPtr(resolveMap.release(), [lease](const prt::ResolveMap* rm) {
+		if (rm != nullptr)
+			rm->destroy();
+		// lease is released together with the last copy of this deleter
+	});
+}
+
+} // namespace
+
+
+std::string getContentHash(const PLD_BOOST_NS::filesystem::path& p) {
+	std::ifstream in(p.string(), std::ifstream::binary);
+	if (!in)
+		return {};
+
+	// FNV-1a style mixing of 64bit words, fast enough to not dominate the unpack time
+	constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+	uint64_t h = 14695981039346656037ULL;
+	uint64_t size = 0;
+
+	std::vector<char> buffer(HASH_BUFFER_SIZE);
+	while (in) {
+		in.read(buffer.data(), buffer.size());
+		const size_t n = static_cast<size_t>(in.gcount());
+		size += n;
+
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+			uint64_t w;
+			std::memcpy(&w, buffer.data() + i, sizeof(w));
+			h = (h ^ w) * FNV_PRIME;
+			h ^= h >> 29;
+		}
+		for (; i < n; i++)
+			h = (h ^ static_cast<uint8_t>(buffer[i])) * FNV_PRIME;
+	}
+
+	std::ostringstream os;
+	os << std::hex << std::setfill('0') << std::setw(16) << h << '_' << size;
+	return os.str();
+}
+
+
+RPKStore::RPKStore(const PLD_BOOST_NS::filesystem::path& root, uintmax_t maxSize) : mRoot(root), mMaxSize(maxSize) {
+	PLD_BOOST_NS::system::error_code ec;
+	PLD_BOOST_NS::filesystem::create_directories(mRoot, ec);
+	if (ec)
+		LOG_ERR << "Could not create RPK store directory " << mRoot << ": " << ec.message();
+	else
+		LOG_INF << "Using RPK store " << mRoot << " (max size " << (mMaxSize / MB) << " MB)";
+}
+
+std::unique_ptr<RPKStore> RPKStore::createFromEnvironment() {
+	const char* e = std::getenv(RPK_STORE_ENV_VAR);
+	if (e == nullptr || std::strlen(e) == 0)
+		return {};
+	return std::unique_ptr<RPKStore>(new RPKStore(e, getMaxSizeFromEnvironment()));
+}
+
+ResolveMapSPtr RPKStore::getResolveMap(const PLD_BOOST_NS::filesystem::path& rpk) {
+	const std::string key = getContentHash(rpk);
+	if (key.empty())
+		return {};
+
+	const PLD_BOOST_NS::filesystem::path entryDir = mRoot / key;
+	const PLD_BOOST_NS::filesystem::path lockPath = mRoot / (key + LOCK_SUFFIX);
+	FileLockSPtr lease = std::make_shared<FileLock>(lockPath);
+
+	for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+		if (!lease->lock(false, true))
+			return {};
+
+		if (!lease->isCurrent()) { // entry has been evicted while we were waiting, start over with a new lock file
+			lease = std::make_shared<FileLock>(lockPath);
+			continue;
+		}
+
+		if (isComplete(entryDir) && hasIndex(entryDir)) {
+			ResolveMapUPtr resolveMap = readIndex(entryDir / ENTRY_INDEX);
+			if (!resolveMap)
+				return {};
+			touch(entryDir / ENTRY_COMPLETE);
+			LOG_INF << "Reusing unpacked RPK " << rpk << " from store entry " << entryDir;
+			return withLease(std::move(resolveMap), lease);
+		}
+
+		// upgrade to exclusive lock, another process might be unpacking the same rpk
+		if (!lease->lock(true, true))
+			return {};
+
+		if (!lease->isCurrent()) {
+			lease = std::make_shared<FileLock>(lockPath);
+			continue;
+		}
+
+		if (!isComplete(entryDir) || !hasIndex(entryDir)) {
+			PLD_BOOST_NS::system::error_code ec;
+			PLD_BOOST_NS::filesystem::remove_all(entryDir, ec); // left-overs of an interrupted unpack
+			PLD_BOOST_NS::filesystem::create_directories(entryDir / ENTRY_UNPACK_DIR, ec);
+
+			const auto rpkURI = toFileURI(rpk);
+			const auto unpackDir = (entryDir / ENTRY_UNPACK_DIR).wstring();
+			prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
+			const ResolveMapUPtr resolveMap(prt::createResolveMap(rpkURI.c_str(), unpackDir.c_str(), &status));
+			if (!resolveMap || status != prt::STATUS_OK || !writeIndex(entryDir / ENTRY_INDEX, resolveMap.get())) {
+				PLD_BOOST_NS::filesystem::remove_all(entryDir, ec);
+				PLD_BOOST_NS::filesystem::remove(lockPath, ec);
+				return {};
+			}
+
+			std::ofstream(PLD_BOOST_NS::filesystem::path(entryDir / ENTRY_COMPLETE).string()) << getDirectorySize(entryDir);
+			LOG_INF << "Unpacked RPK " << rpk << " into store entry " << entryDir;
+
+			lease->unlock();
+			evict(key);
+		}
+		// continue with a shared lock, the entry could have been evicted in between
+	}
+
+	return {};
+}
+
+/**
+ * removes least recently used entries until the store fits into its size limit, entries in use are skipped
+ */
+void RPKStore::evict(const std::string& currentKey) {
+	struct Entry {
+		std::string key;
+		std::time_t lastUse;
+		uintmax_t   size;
+	};
+	std::vector<Entry> entries;
+	uintmax_t totalSize = 0;
+
+	PLD_BOOST_NS::system::error_code ec;
+	for (PLD_BOOST_NS::filesystem::directory_iterator it(mRoot, ec), end; !ec && it != end; it.increment(ec)) {
+		const auto& dir = it->path();
+		if (!PLD_BOOST_NS::filesystem::is_directory(dir, ec) || !isComplete(dir))
+			continue;
+
+		uintmax_t size = 0;
+		std::ifstream((dir / ENTRY_COMPLETE).string()) >> size;
+		const std::time_t lastUse = PLD_BOOST_NS::filesystem::last_write_time(dir / ENTRY_COMPLETE, ec);
+		entries.push_back({ dir.filename().string(), lastUse, size });
+		totalSize += size;
+	}
+
+	if (totalSize <= mMaxSize)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+	for (const auto& e: entries) {
+		if (totalSize <= mMaxSize)
+			break;
+		if (e.key == currentKey)
+			continue;
+
+		const PLD_BOOST_NS::filesystem::path lockPath = mRoot / (e.key + LOCK_SUFFIX);
+		FileLock lock(lockPath);
+		if (!lock.lock(true, false) || !lock.isCurrent()) // in use by this or another process, or already evicted
+			continue;
+
+		PLD_BOOST_NS::filesystem::remove(mRoot / e.key / ENTRY_COMPLETE, ec); // invalidate first
+		PLD_BOOST_NS::filesystem::remove_all(mRoot / e.key, ec);
+		PLD_BOOST_NS::filesystem::remove(lockPath, ec); // while still locked, waiting processes detect it with isCurrent()
+		totalSize -= std::min(totalSize, e.size);
+		LOG_INF << "Evicted RPK store entry " << e.key << " (" << (e.size / MB) << " MB)";
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Utils.h"
+
+#include "BoostRedirect.h"
+#include PLD_BOOST_INCLUDE(/filesystem.hpp)
+
+#include <memory>
+#include <string>
+
+
+/**
+ * Persistent store of unpacked rule packages, shared by all Houdini processes using the same store directory
+ * (enabled with the PALLADIO_RPK_STORE environment variable).
+ *
+ * Entries are addressed by a hash of the RPK content, i.e. a changed RPK results in a new entry and an unchanged
+ * RPK is only unpacked once across sessions. Each entry stores the unpacked files and the keys/URIs of its resolve map.
+ * Processes coordinate with file locks: an entry is unpacked under an exclusive lock and is kept alive by a shared
+ * lock while a resolve map into it is in use. Least recently used entries are evicted if the store grows beyond
+ * its size limit (PALLADIO_RPK_STORE_SIZE_MB).
+ */
+class RPKStore {
+public:
+	RPKStore(const PLD_BOOST_NS::filesystem::path& root, uintmax_t maxSize);
+	RPKStore(const RPKStore&) = delete;
+	RPKStore(RPKStore&&) = delete;
+	RPKStore& operator=(RPKStore const&) = delete;
+	RPKStore& operator=(RPKStore&&) = delete;
+	~RPKStore() = default;
+
+	// returns nullptr if the store is not enabled
+	static std::unique_ptr<RPKStore> createFromEnvironment();
+
+	// the returned resolve map holds a shared lock on its store entry, returns an empty pointer on failure
+	ResolveMapSPtr getResolveMap(const PLD_BOOST_NS::filesystem::path& rpk);
+
+private:
+	void evict(const std::string& currentKey);
+
+	const PLD_BOOST_NS::filesystem::path mRoot;
+	const uintmax_t                      mMaxSize;
+};
+
+using RPKStoreUPtr = std::unique_ptr<RPKStore>;
+
+PLD_TEST_EXPORTS_API std::string getContentHash(const PLD_BOOST_NS::filesystem::path& p);
@@ -20,6 +20,10 @@
 #include "UT/UT_IStream.h"
 #include "FS/FS_Reader.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
 
 namespace {
 
@@ -27,6 +31,21 @@ const ResolveMapSPtr RESOLVE_MAP_NONE;
 const ResolveMapCache::LookupResult LOOKUP_FAILURE = { RESOLVE_MAP_NONE, ResolveMapCache::CacheStatus::MISS };
 const std::chrono::system_clock::time_point INVALID_TIMESTAMP;
 
+constexpr const char* RPK_IN_PLACE_ENV_VAR = "PALLADIO_RPK_IN_PLACE";
+
+bool isInPlaceEnabled() {
+	const char* e = std::getenv(RPK_IN_PLACE_ENV_VAR);
+	return (e != nullptr) && (std::strcmp(e, "1") == 0);
+}
+
+// rpk time stamps are checked at most once per interval, i.e. lookups during a cook do not hit the file system
+constexpr int64_t VALIDATION_INTERVAL = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)).count();
+constexpr int64_t NEVER_VALIDATED = std::numeric_limits<int64_t>::min() / 2;
+
+int64_t getValidationTime() {
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
 constexpr const char* SCHEMA_OPDEF = "opdef:";
 constexpr const char* SCHEMA_OPLIB = "oplib:";
 const std::vector<std::string> EMBEDDED_SCHEMAS = { SCHEMA_OPDEF, SCHEMA_OPLIB };
@@ -67,25 +86,30 @@ ResolveMapCache::KeyType createCacheKey(const PLD_BOOST_NS::filesystem::path& rp
 
 struct PathRemover {
 	void operator()(PLD_BOOST_NS::filesystem::path const* p) {
-		if (p && PLD_BOOST_NS::filesystem::exists(*p)) {
-			PLD_BOOST_NS::filesystem::remove(*p);
+		if (p == nullptr)
+			return;
+		PLD_BOOST_NS::system::error_code ec; // called from destructors, must not throw
+		if (PLD_BOOST_NS::filesystem::remove(*p, ec))
 			LOG_DBG << "Removed file " << *p;
-			delete p;
-		}
+		delete p;
 	}
 };
 using ScopedPath = std::unique_ptr<PLD_BOOST_NS::filesystem::path,PathRemover>;
 
-ScopedPath resolveFromHDA(const PLD_BOOST_NS::filesystem::path& p) {
+std::string getHDAResourceName(const PLD_BOOST_NS::filesystem::path& p) {
+	auto resName = p.leaf().string();
+	std::replace(resName.begin(), resName.end(), '?', '_'); // TODO: generalize
+	return resName;
+}
+
+ScopedPath resolveFromHDA(const PLD_BOOST_NS::filesystem::path& p, const PLD_BOOST_NS::filesystem::path& target) {
 	LOG_DBG << "detected embedded resource in HDA: " << p;
 
 	FS_Reader fsr(p.string().c_str()); // is able to resolve opdef/oplib URIs
 	UT_StringHolder container = getFSReaderFilename(fsr);
 	LOG_DBG << "resource container: " << container;
 
-	auto resName = p.leaf().string();
-	std::replace(resName.begin(), resName.end(), '?', '_'); // TODO: generalize
-	ScopedPath extractedResource(new PLD_BOOST_NS::filesystem::path(PLD_BOOST_NS::filesystem::temp_directory_path() / resName));
+	ScopedPath extractedResource(new PLD_BOOST_NS::filesystem::path(target));
 
 	if (fsr.isGood()) {
 		UT_WorkBuffer wb;
@@ -104,13 +128,63 @@ ScopedPath resolveFromHDA(const PLD_BOOST_NS::filesystem::path& p) {
 } // namespace
 
 
+ResolveMapCache::ResolveMapCache(const PLD_BOOST_NS::filesystem::path& unpackPath)
+	: mRPKUnpackPath{unpackPath}, mInPlace{isInPlaceEnabled()}, mRPKStore{mInPlace ? RPKStoreUPtr() : RPKStore::createFromEnvironment()}
+{
+	if (mInPlace)
+		LOG_INF << "Reading rule packages in-place (no unpacking)";
+}
+
 ResolveMapCache::~ResolveMapCache() {
     PLD_BOOST_NS::filesystem::remove_all(mRPKUnpackPath);
     LOG_INF << "Removed RPK unpack directory";
 }
 
-ResolveMapCache::LookupResult ResolveMapCache::get(const PLD_BOOST_NS::filesystem::path& rpk) {
+void ResolveMapCache::requestValidation(const PLD_BOOST_NS::filesystem::path& rpk) {
+	UT_AutoReadLock readLock(mCacheLock);
+	const auto it = mCache.find(createCacheKey(rpk));
+	if (it != mCache.end())
+		it->second.mValidationTime.store(NEVER_VALIDATED);
+}
+
+bool ResolveMapCache::isCurrent(const PLD_BOOST_NS::filesystem::path& rpk, const ResolveMapSPtr& resolveMap) {
+	UT_AutoReadLock readLock(mCacheLock);
+	const auto it = mCache.find(createCacheKey(rpk));
+	if (it == mCache.end())
+		return false;
+	const std::shared_future<ResolveMapSPtr>& f = it->second.mResolveMap;
+	return (f.wait_for(std::chrono::seconds(0)) == std::future_status::ready) && (f.get() == resolveMap);
+}
+
+PLD_BOOST_NS::filesystem::path ResolveMapCache::getHDAExtractionPath(const PLD_BOOST_NS::filesystem::path& p) {
+	// unique per process and load: loads of different rule packages run concurrently (and in several processes with
+	// the RPK store), also the extracted file is in use until an in-place resolve map is released
+	PLD_BOOST_NS::system::error_code ec;
+	PLD_BOOST_NS::filesystem::create_directories(mRPKUnpackPath, ec);
+	return mRPKUnpackPath / (std::to_string(++mHDAExtractionCount) + "_" + getHDAResourceName(p));
+}
+
+ResolveMapCache::LookupResult ResolveMapCache::wait(const std::shared_future<ResolveMapSPtr>& resolveMap) const {
+	const ResolveMapSPtr rm = resolveMap.get(); // blocks while another thread is unpacking the rpk
+	if (!rm)
+		return LOOKUP_FAILURE;
+	return { rm, CacheStatus::HIT };
+}
+
+ResolveMapCache::LookupResult ResolveMapCache::get(const PLD_BOOST_NS::filesystem::path& rpk, const InvalidationCallback& invalidate) {
 	const auto cacheKey = createCacheKey(rpk);
+	const auto now = getValidationTime();
+
+	// fastest path: entry has been validated recently, skip the file system access
+	std::shared_future<ResolveMapSPtr> cachedResolveMap;
+	{
+		UT_AutoReadLock readLock(mCacheLock);
+		const auto it = mCache.find(cacheKey);
+		if (it != mCache.end() && (now - it->second.mValidationTime.load() < VALIDATION_INTERVAL))
+			cachedResolveMap = it->second.mResolveMap;
+	}
+	if (cachedResolveMap.valid())
+		return wait(cachedResolveMap);
 
 	const auto timeStamp = getFileModificationTime(rpk);
 	LOG_DBG << "rpk: current timestamp: " << std::chrono::duration_cast<std::chrono::nanoseconds>(timeStamp.time_since_epoch()).count() << "ns";
@@ -119,46 +193,132 @@ ResolveMapCache::LookupResult ResolveMapCache::get(const PLD_BOOST_NS::filesyste
 	if (timeStamp == INVALID_TIMESTAMP)
 		return LOOKUP_FAILURE;
 
-	CacheStatus cs = CacheStatus::HIT;
-	auto it = mCache.find(cacheKey);
-	if (it != mCache.end()) {
-		LOG_DBG << "rpk: cache timestamp: " << std::chrono::duration_cast<std::chrono::nanoseconds>(it->second.mTimeStamp.time_since_epoch()).count() << "ns";
-		if (it->second.mTimeStamp != timeStamp) {
-			mCache.erase(it);
-			const auto cnt = PLD_BOOST_NS::filesystem::remove_all(mRPKUnpackPath / rpk.leaf());
-			LOG_INF << "RPK change detected, forcing reload and clearing cache for " << rpk << " (removed " << cnt << " files)";
-			cs = CacheStatus::MISS;
+	// fast path: rpk is already unpacked or being unpacked by another thread
+	{
+		UT_AutoReadLock readLock(mCacheLock);
+		const auto it = mCache.find(cacheKey);
+		if (it != mCache.end() && it->second.mTimeStamp == timeStamp) {
+			it->second.mValidationTime.store(now);
+			cachedResolveMap = it->second.mResolveMap;
 		}
 	}
-	else
-		cs = CacheStatus::MISS;
-
-	if (cs == CacheStatus::MISS) {
-		ScopedPath extractedPath; // if set, will resolve the extracted RPK from HDA
-		const auto actualRPK = [&extractedPath](const PLD_BOOST_NS::filesystem::path& p) {
-			if (isEmbedded(p)) {
-				extractedPath = resolveFromHDA(p);
-				return *extractedPath;
+	if (cachedResolveMap.valid())
+		return wait(cachedResolveMap);
+
+	// slow path: register a pending entry, then unpack without holding the lock
+	std::promise<ResolveMapSPtr> promise;
+	std::shared_future<ResolveMapSPtr> staleResolveMap; // might still be loading
+	bool isReload = false;
+	{
+		UT_AutoWriteLock writeLock(mCacheLock);
+		auto it = mCache.find(cacheKey);
+		if (it != mCache.end()) {
+			LOG_DBG << "rpk: cache timestamp: " << std::chrono::duration_cast<std::chrono::nanoseconds>(it->second.mTimeStamp.time_since_epoch()).count() << "ns";
+			if (it->second.mTimeStamp == timeStamp) // another thread was faster
+				cachedResolveMap = it->second.mResolveMap;
+		}
+		if (!cachedResolveMap.valid()) {
+			if (it != mCache.end()) {
+				staleResolveMap = it->second.mResolveMap;
+				mCache.erase(it);
+				isReload = true;
 			}
-			else
-				return p;
-		}(rpk);
+			ResolveMapCacheEntry& entry = mCache[cacheKey];
+			entry.mResolveMap = promise.get_future().share();
+			entry.mTimeStamp = timeStamp;
+			entry.mValidationTime.store(now);
+		}
+	}
+	if (cachedResolveMap.valid())
+		return wait(cachedResolveMap);
+
+	// the pending entry must always be resolved, otherwise waiting lookups would get a broken promise
+	ResolveMapSPtr resolveMap;
+	try {
+		// a pending stale entry is waited for, otherwise its dependent cache entries could not be invalidated.
+		// invalidation happens before publishing, waiting lookups must not see entries of the stale resolve map.
+		const ResolveMapSPtr stale = staleResolveMap.valid() ? staleResolveMap.get() : RESOLVE_MAP_NONE;
+		if (invalidate)
+			invalidate(stale);
+
+		resolveMap = load(rpk, isReload);
+	}
+	catch (const std::exception& e) {
+		LOG_ERR << "Failed to load rule package " << rpk << ": " << e.what();
+	}
+	catch (...) {
+		LOG_ERR << "Failed to load rule package " << rpk;
+	}
+
+	if (!resolveMap) {
+		promise.set_value(RESOLVE_MAP_NONE);
+
+		// drop the failed entry so the next lookup retries
+		UT_AutoWriteLock writeLock(mCacheLock);
+		const auto it = mCache.find(cacheKey);
+		if (it != mCache.end() && it->second.mTimeStamp == timeStamp)
+			mCache.erase(it);
+		return LOOKUP_FAILURE;
+	}
+
+	promise.set_value(resolveMap);
 
+	return { resolveMap, CacheStatus::MISS };
+}
+
+ResolveMapSPtr ResolveMapCache::load(const PLD_BOOST_NS::filesystem::path& rpk, bool isReload) {
+	if (isReload) {
+		PLD_BOOST_NS::system::error_code ec;
+		const auto cnt = PLD_BOOST_NS::filesystem::remove_all(mRPKUnpackPath / rpk.leaf(), ec);
+		LOG_INF << "RPK change detected, forcing reload and clearing cache for " << rpk << " (removed " << cnt << " files)";
+		if (ec)
+			LOG_WRN << "Could not remove all previously unpacked files of " << rpk << ": " << ec.message();
+	}
+
+	ScopedPath extractedPath; // if set, will resolve the extracted RPK from HDA
+	const auto actualRPK = [this, &extractedPath](const PLD_BOOST_NS::filesystem::path& p) {
+		if (isEmbedded(p)) {
+			extractedPath = resolveFromHDA(p, getHDAExtractionPath(p));
+			return *extractedPath;
+		}
+		else
+			return p;
+	}(rpk);
+
+	ResolveMapSPtr resolveMap;
+	if (mInPlace) {
 		const auto rpkURI = toFileURI(actualRPK);
 
-		ResolveMapCacheEntry rmce;
-		rmce.mTimeStamp = timeStamp;
+		prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
+		LOG_DBG << "createResolveMap (in-place) from " << rpkURI;
+		resolveMap.reset(prt::createResolveMap(rpkURI.c_str(), nullptr, &status), PRTDestroyer());
+		if (status != prt::STATUS_OK)
+			resolveMap.reset();
+		else if (extractedPath) {
+			// PRT reads from the archive on demand, keep the extracted HDA resource as long as the resolve map lives
+			struct InPlaceResolveMap {
+				ResolveMapSPtr resolveMap;
+				ScopedPath     archive;
+			};
+			auto holder = std::make_shared<InPlaceResolveMap>();
+			holder->resolveMap = std::move(resolveMap);
+			holder->archive = std::move(extractedPath);
+			resolveMap = ResolveMapSPtr(holder, holder->resolveMap.get());
+		}
+	}
+	else if (mRPKStore)
+		resolveMap = mRPKStore->getResolveMap(actualRPK);
+	else {
+		const auto rpkURI = toFileURI(actualRPK);
 
 		prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
 		LOG_DBG << "createResolveMap from " << rpkURI;
-		rmce.mResolveMap.reset(prt::createResolveMap(rpkURI.c_str(), mRPKUnpackPath.wstring().c_str(), &status), PRTDestroyer());
+		resolveMap.reset(prt::createResolveMap(rpkURI.c_str(), mRPKUnpackPath.wstring().c_str(), &status), PRTDestroyer());
 		if (status != prt::STATUS_OK)
-			return LOOKUP_FAILURE;
-
-		it = mCache.emplace(cacheKey, std::move(rmce)).first;
-		LOG_INF << "Upacked RPK " << actualRPK << " to " << mRPKUnpackPath;
+			resolveMap.reset();
+		else
+			LOG_INF << "Upacked RPK " << actualRPK << " to " << mRPKUnpackPath;
 	}
 
-	return { it->second.mResolveMap, cs };
+	return resolveMap;
 }
-
@@ -17,19 +17,31 @@
 #pragma once
 
 #include "Utils.h"
+#include "RPKStore.h"
 
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/filesystem.hpp)
 
+#include "UT/UT_RWLock.h"
+
 #include <map>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <future>
 
 
+/**
+ * Thread-safe cache of resolve maps (i.e. unpacked rule packages). Lookups of already unpacked rule packages only
+ * take a shared lock and only check the rpk file time stamp once per validation interval. Concurrent lookups of the
+ * same rule package wait for a single unpack which runs without holding the lock, i.e. lookups of other rule packages
+ * are not blocked.
+ */
 class ResolveMapCache {
 public:
 	using KeyType = std::string;
 
-	explicit ResolveMapCache(const PLD_BOOST_NS::filesystem::path& unpackPath) : mRPKUnpackPath{unpackPath} { }
+	explicit ResolveMapCache(const PLD_BOOST_NS::filesystem::path& unpackPath);
 	ResolveMapCache(const ResolveMapCache&) = delete;
 	ResolveMapCache(ResolveMapCache&&) = delete;
 	ResolveMapCache& operator=(ResolveMapCache const&) = delete;
@@ -38,17 +50,41 @@ public:
 
 	enum class CacheStatus { HIT, MISS };
 	using LookupResult = std::pair<ResolveMapSPtr, CacheStatus>;
-	LookupResult get(const PLD_BOOST_NS::filesystem::path& rpk);
+
+	/**
+	 * called by the thread which (re-)loads a rule package before the new resolve map is returned to any other
+	 * lookup, e.g. to invalidate dependent cache entries. staleResolveMap is the replaced resolve map (null if there
+	 * was none or it failed to load).
+	 */
+	using InvalidationCallback = std::function<void(const ResolveMapSPtr& staleResolveMap)>;
+
+	// returns MISS only to the caller which actually (re-)loaded the rule package
+	LookupResult get(const PLD_BOOST_NS::filesystem::path& rpk, const InvalidationCallback& invalidate = {});
+
+	// the time stamp of rpk will be checked by the next lookup (lookups are only validated periodically)
+	void requestValidation(const PLD_BOOST_NS::filesystem::path& rpk);
+
+	// true if resolveMap has not been replaced by a reload of rpk yet (does not check the time stamp)
+	bool isCurrent(const PLD_BOOST_NS::filesystem::path& rpk, const ResolveMapSPtr& resolveMap);
 
 private:
+	LookupResult wait(const std::shared_future<ResolveMapSPtr>& resolveMap) const;
+	ResolveMapSPtr load(const PLD_BOOST_NS::filesystem::path& rpk, bool isReload); // unpacks rpk, may throw
+	PLD_BOOST_NS::filesystem::path getHDAExtractionPath(const PLD_BOOST_NS::filesystem::path& p);
+
 	struct ResolveMapCacheEntry {
-		ResolveMapSPtr mResolveMap;
+		std::shared_future<ResolveMapSPtr> mResolveMap; // not ready while the rpk is being unpacked
 		std::chrono::system_clock::time_point mTimeStamp;
+		std::atomic<int64_t> mValidationTime{0}; // steady clock ticks, updated by concurrent readers
 	};
 	using Cache = std::map<KeyType, ResolveMapCacheEntry>;
 	Cache mCache;
+	UT_RWLock mCacheLock;
 
 	const PLD_BOOST_NS::filesystem::path mRPKUnpackPath;
+	const bool mInPlace; // read assets directly from the rpk archive (PALLADIO_RPK_IN_PLACE=1), no unpacking
+	const RPKStoreUPtr mRPKStore; // optional, replaces the per-process unpack path
+	std::atomic<uint64_t> mHDAExtractionCount{0};
 };
 
-using ResolveMapCacheUPtr = std::unique_ptr<ResolveMapCache>;
\ No newline at end of file
+using ResolveMapCacheUPtr = std::unique_ptr<ResolveMapCache>;
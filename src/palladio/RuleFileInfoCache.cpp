@@ -0,0 +1,142 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RuleFileInfoCache.h"
+#include "AttributeConversion.h"
+#include "LogHandler.h"
+
+#include "prt/API.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <set>
+
+
+namespace {
+
+constexpr const wchar_t* CGA_ANNOTATION_START_RULE = L"@StartRule";
+constexpr const wchar_t* CGA_ANNOTATION_HIDDEN     = L"@Hidden";
+
+bool hasAnnotation(const prt::RuleFileInfo::Entry* e, const wchar_t* annotation) {
+	for (size_t ai = 0, numAnns = e->getNumAnnotations(); ai < numAnns; ai++) {
+		if (std::wcscmp(e->getAnnotation(ai)->getName(), annotation) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool compareSecond(const RuleFileInfoCache::StringPairVector::value_type& a,
+                   const RuleFileInfoCache::StringPairVector::value_type& b)
+{
+	return (a.second < b.second);
+}
+
+std::string extractStyle(const prt::RuleFileInfo::Entry* re) {
+	std::wstring style, name;
+	NameConversion::separate(re->getName(), style, name);
+	return toOSNarrowFromUTF16(style);
+}
+
+void createDerivedData(RuleFileInfoCache::Entry& entry) {
+	const prt::RuleFileInfo* rfi = entry.ruleFileInfo.get();
+
+	// start rule: annotated start rule (the last one wins if there are several) or just first rule as fallback
+	RuleFileInfoCache::StringPairVector startRules, rules;
+	std::set<std::string> styles;
+	for (size_t ri = 0, numRules = rfi->getNumRules(); ri < numRules; ri++) {
+		const prt::RuleFileInfo::Entry* re = rfi->getRule(ri);
+		const std::string rn = toOSNarrowFromUTF16(NameConversion::removeStyle(re->getName()));
+
+		if (hasAnnotation(re, CGA_ANNOTATION_START_RULE)) {
+			entry.startRule = re->getName();
+			startRules.emplace_back(rn, rn + " (@StartRule)");
+		}
+		else
+			rules.emplace_back(rn, rn);
+
+		styles.emplace(extractStyle(re));
+	}
+	if (entry.startRule.empty() && rfi->getNumRules() > 0)
+		entry.startRule = rfi->getRule(0)->getName();
+
+	std::sort(startRules.begin(), startRules.end(), compareSecond);
+	std::sort(rules.begin(), rules.end(), compareSecond);
+	entry.startRuleMenu.reserve(startRules.size() + rules.size());
+	entry.startRuleMenu.insert(entry.startRuleMenu.end(), startRules.begin(), startRules.end());
+	entry.startRuleMenu.insert(entry.startRuleMenu.end(), rules.begin(), rules.end());
+
+	for (size_t ai = 0, numAttrs = rfi->getNumAttributes(); ai < numAttrs; ai++) {
+		const prt::RuleFileInfo::Entry* ae = rfi->getAttribute(ai);
+		if (hasAnnotation(ae, CGA_ANNOTATION_HIDDEN))
+			entry.hiddenAttributes.insert(ae->getName());
+		styles.emplace(extractStyle(ae));
+	}
+
+	entry.styles.assign(styles.begin(), styles.end());
+}
+
+} // namespace
+
+
+RuleFileInfoCache::EntrySPtr RuleFileInfoCache::get(const std::string& rpk, const wchar_t* cgbURI, prt::Cache* prtCache) {
+	if (cgbURI == nullptr)
+		return {};
+
+	const EntrySPtr cachedEntry = find(cgbURI);
+	if (cachedEntry)
+		return cachedEntry;
+
+	// parse the CGB outside of the lock, concurrent misses for the same URI are rare and resolved below
+	const EntrySPtr entry = create(cgbURI, prtCache);
+	if (!entry)
+		return {};
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCache.emplace(cgbURI, CacheEntry{ rpk, entry }).first->second.mEntry;
+}
+
+RuleFileInfoCache::EntrySPtr RuleFileInfoCache::find(const wchar_t* cgbURI) {
+	if (cgbURI == nullptr)
+		return {};
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	const auto it = mCache.find(cgbURI);
+	return (it != mCache.end()) ? it->second.mEntry : EntrySPtr();
+}
+
+RuleFileInfoCache::EntrySPtr RuleFileInfoCache::create(const wchar_t* cgbURI, prt::Cache* prtCache) {
+	prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
+	RuleFileInfoUPtr rfi(prt::createRuleFileInfo(cgbURI, prtCache, &status));
+	if (!rfi || (status != prt::STATUS_OK)) {
+		LOG_DBG << "failed to get rule file info for " << cgbURI << ": " << prt::getStatusDescription(status);
+		return {};
+	}
+
+	std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+	entry->ruleFileInfo = std::move(rfi);
+	createDerivedData(*entry);
+	return entry;
+}
+
+void RuleFileInfoCache::invalidate(const std::string& rpk) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto it = mCache.begin(); it != mCache.end();) {
+		if (it->second.mRPK == rpk)
+			it = mCache.erase(it);
+		else
+			++it;
+	}
+}
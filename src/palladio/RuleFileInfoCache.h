@@ -0,0 +1,73 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Utils.h"
+
+#include "prt/RuleFileInfo.h"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * Caches rule file infos and data derived from them (start rule, menu entries, hidden attributes) by CGB URI.
+ * Entries are dropped together with the resolve map of their rule package (see PRTContext::getResolveMap), use
+ * PRTContext::getRuleFileInfo to not insert entries of a stale resolve map after that.
+ */
+class RuleFileInfoCache {
+public:
+	using StringPairVector = std::vector<std::pair<std::string, std::string>>;
+
+	// immutable after creation, all keys point into ruleFileInfo
+	struct Entry {
+		RuleFileInfoUPtr         ruleFileInfo;
+		std::wstring             startRule;          // fully qualified, annotated start rule or first rule
+		StringPairVector         startRuleMenu;      // token/label, annotated start rules first, sorted by label
+		std::vector<std::string> styles;             // sorted
+		WCharPtrSet              hiddenAttributes;   // names of attributes with @Hidden annotation
+	};
+	using EntrySPtr = std::shared_ptr<const Entry>;
+
+	RuleFileInfoCache() = default;
+	RuleFileInfoCache(const RuleFileInfoCache&) = delete;
+	RuleFileInfoCache(RuleFileInfoCache&&) = delete;
+	RuleFileInfoCache& operator=(RuleFileInfoCache const&) = delete;
+	RuleFileInfoCache& operator=(RuleFileInfoCache&&) = delete;
+
+	// returns an empty pointer if the rule file info cannot be created
+	EntrySPtr get(const std::string& rpk, const wchar_t* cgbURI, prt::Cache* prtCache);
+	EntrySPtr find(const wchar_t* cgbURI); // does not create missing entries
+	void invalidate(const std::string& rpk);
+
+	// creates an entry which is not cached (prtCache may be null)
+	static EntrySPtr create(const wchar_t* cgbURI, prt::Cache* prtCache);
+
+private:
+	struct CacheEntry {
+		std::string mRPK;
+		EntrySPtr   mEntry;
+	};
+
+	std::mutex                          mMutex;
+	std::map<std::wstring, CacheEntry>  mCache;
+};
+
+using RuleFileInfoCacheUPtr = std::unique_ptr<RuleFileInfoCache>;
@@ -21,16 +21,21 @@
 #include "ShapeData.h"
 #include "ModelConverter.h"
 #include "NodeParameter.h"
+#include "BatchGenerate.h"
 #include "LogHandler.h"
-#include "MultiWatch.h"
+#include "Tracer.h"
 
 #include "prt/API.h"
 
 #include "UT/UT_Interrupt.h"
+#include "CH/CH_Manager.h"
 
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/algorithm/string.hpp)
 
+#include <algorithm>
+#include <map>
+
 
 namespace {
 
@@ -44,42 +49,188 @@ AttributeMapUPtr getValidEncoderInfo(const wchar_t* encID) {
 	return AttributeMapUPtr(encOpts);
 }
 
-RuleFileInfoUPtr getRuleFileInfo(const MainAttributes& ma, const ResolveMapSPtr& resolveMap, prt::Cache* prtCache) {
-	if (!resolveMap->hasKey(ma.mRuleFile.c_str())) // workaround for bug in getString
-		return {};
+using RuleFileInfoVector = std::vector<RuleFileInfoCache::EntrySPtr>;
+
+using AttributeMapSPtr = DefaultAttributeCache::AttributeMapSPtr;
+
+AttributeMapSPtr toShared(const prt::AttributeMap* attrMap) {
+	return AttributeMapSPtr(attrMap, PRTDestroyer());
+}
+
+void setDefaultAttributes(AttributeMapBuilderUPtr& amb, const AttributeMapSPtr& defaultAttributes) {
+	amb.reset(prt::AttributeMapBuilder::createFromAttributeMap(defaultAttributes.get()));
+}
+
+/**
+ * runs the attribute evaluation encoder on the initial shapes selected by isIndices, batched over threads like in
+ * SOPGenerate. The results are written into ambs at the same indices.
+ */
+bool generateDefaultAttributes(const InitialShapeNOPtrVector& allShapes, const std::vector<size_t>& isIndices,
+                               AttributeMapBuilderVector& ambs, const RuleFileInfoVector& ruleFileInfos,
+                               const PRTContextUPtr& prtCtx)
+{
+	if (isIndices.empty())
+		return true;
+
+	InitialShapeNOPtrVector is(isIndices.size());
+	std::transform(isIndices.begin(), isIndices.end(), is.begin(), [&allShapes](size_t i) { return allShapes[i]; });
+
+	// setup encoder options for attribute evaluation encoder
+	const std::vector<const wchar_t*> allEncoders = { ENCODER_ID_CGA_EVALATTR };
+	const AttributeMapUPtr encOpts = getValidEncoderInfo(ENCODER_ID_CGA_EVALATTR);
+	const AttributeMapNOPtrVector allEncoderOptions = { encOpts.get() };
+
+	const size_t nThreads = std::min<size_t>(prtCtx->mCores, is.size());
+	const size_t isRangeSize = getBatchRangeSize(is.size(), nThreads);
+
+	// used to filter generated attributes, shared by all threads
+	std::vector<const WCharPtrSet*> hiddenAttributes(ruleFileInfos.size(), nullptr);
+	for (size_t i: isIndices) {
+		if (ruleFileInfos[i])
+			hiddenAttributes[i] = &ruleFileInfos[i]->hiddenAttributes;
+	}
+
+	// one callbacks instance per generate call, each one writes into its own set of rule attribute builders
+	std::vector<std::unique_ptr<AttrEvalCallbacks>> aecs(nThreads);
+	std::vector<prt::Callbacks*> callbacks(nThreads);
+	for (size_t ti = 0; ti < nThreads; ti++) {
+		aecs[ti].reset(new AttrEvalCallbacks(ambs, hiddenAttributes, isIndices, getBatchStart(ti, isRangeSize)));
+		callbacks[ti] = aecs[ti].get();
+	}
+
+	AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+	amb->setInt(L"numberWorkerThreads", prtCtx->mCores);
+	const AttributeMapUPtr genOpts(amb->createAttributeMapAndReset());
+
+	const std::vector<prt::Status> batchStatus = batchGenerate(BatchMode::GENERATION, nThreads, callbacks, isRangeSize, is,
+	                                                           allEncoders, allEncoderOptions, nullptr, nullptr,
+	                                                           prtCtx->mPRTCache.get(), genOpts.get());
+	bool success = true;
+	for (const prt::Status& stat: batchStatus) {
+		if (stat != prt::STATUS_OK) {
+			LOG_ERR << "assign: prt::generate() failed with status: '" << prt::getStatusDescription(stat) << "' (" << stat << ")";
+			success = false;
+		}
+	}
+	return success;
+}
+
+// quads which differ in size, location and random seed
+struct ProbeShape {
+	std::vector<double> coords;
+	int32_t             randomSeed;
+};
+const ProbeShape PROBE_SHAPES[] = {
+	{ {    0.0,  0.0,    0.0,     0.0,  0.0,   10.0,    10.0,  0.0,   10.0,    10.0,  0.0,    0.0 },    0 },
+	{ { 1000.0, 20.0, -500.0,  1000.0, 20.0, -463.0,  1023.0, 20.0, -463.0,  1023.0, 20.0, -500.0 }, 6661 },
+	{ {  -50.0, -3.0,   70.0,   -50.0, -3.0,   70.5,   -49.5, -3.0,   70.5,   -49.5, -3.0,   70.0 },  -42 }
+};
+const std::vector<uint32_t> PROBE_INDICES     = { 0, 1, 2, 3 };
+const std::vector<uint32_t> PROBE_FACE_COUNTS = { 4 };
+
+} // namespace
+
+
+/**
+ * evaluates the default rule attributes on the probe shapes, an attribute is considered invariant if its values are
+ * equal on all probes (i.e. this is a heuristic, see SHARE_INVARIANT_DEFAULTS parameter)
+ */
+DefaultAttributeCache::Invariance evaluateInvariance(const MainAttributes& ma, const ResolveMapSPtr& resolveMap,
+                                                     const RuleFileInfoCache::EntrySPtr& ruleFileInfo,
+                                                     const PRTContextUPtr& prtCtx,
+                                                     AttributeMapSPtr& invariantAttributes)
+{
+	using Invariance = DefaultAttributeCache::Invariance;
+
+	const AttributeMapBuilderUPtr emptyAttrBuilder(prt::AttributeMapBuilder::create());
+	const AttributeMapUPtr emptyAttrs(emptyAttrBuilder->createAttributeMap());
+
+	std::vector<InitialShapeUPtr> probes;
+	InitialShapeNOPtrVector is;
+	RuleFileInfoVector ruleFileInfos;
+	AttributeMapBuilderVector ambs;
+	std::vector<size_t> isIndices;
+	for (const auto& ps: PROBE_SHAPES) {
+		InitialShapeBuilderUPtr isb(prt::InitialShapeBuilder::create());
+		isb->setGeometry(ps.coords.data(), ps.coords.size(), PROBE_INDICES.data(), PROBE_INDICES.size(),
+		                 PROBE_FACE_COUNTS.data(), PROBE_FACE_COUNTS.size(), nullptr, 0);
+		isb->setAttributes(ma.mRuleFile.c_str(), ma.mStartRule.c_str(), ps.randomSeed, L"probe", emptyAttrs.get(),
+		                   resolveMap.get());
+
+		prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
+		InitialShapeUPtr probe(isb->createInitialShapeAndReset(&status));
+		if (status != prt::STATUS_OK || !probe)
+			return Invariance::VARIANT;
+
+		isIndices.push_back(is.size());
+		is.push_back(probe.get());
+		probes.emplace_back(std::move(probe));
+		ruleFileInfos.push_back(ruleFileInfo);
+		ambs.emplace_back(prt::AttributeMapBuilder::create());
+	}
+
+	if (!generateDefaultAttributes(is, isIndices, ambs, ruleFileInfos, prtCtx))
+		return Invariance::VARIANT;
+
+	std::vector<AttributeMapUPtr> results;
+	for (const auto& amb: ambs)
+		results.emplace_back(amb->createAttributeMap());
 
-	const auto cgbURI = resolveMap->getString(ma.mRuleFile.c_str());
-	if (cgbURI == nullptr)
-		return {};
+	// compare per attribute and only keep the ones with equal values on all probes
+	bool allEqual = true;
+	AttributeMapUPtr equalAttributes = createEqualAttributeMap(results[0].get(), results[1].get());
+	for (size_t i = 1; i < results.size(); i++) {
+		allEqual = allEqual && equalAttributeMaps(results[0].get(), results[i].get());
+		if (i > 1)
+			equalAttributes = createEqualAttributeMap(equalAttributes.get(), results[i].get());
+	}
+
+	if (allEqual) {
+		invariantAttributes = toShared(results[0].release());
+		return Invariance::INVARIANT;
+	}
 
-	prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
-	RuleFileInfoUPtr rfi(prt::createRuleFileInfo(cgbURI, prtCache, &status));
-	if (status != prt::STATUS_OK)
-		return {};
+	size_t equalKeyCount = 0;
+	equalAttributes->getKeys(&equalKeyCount);
+	if (equalKeyCount == 0)
+		return Invariance::VARIANT;
 
-	return rfi;
+	if (DBG) LOG_DBG << "rule " << ma.mRuleFile << ": " << equalKeyCount << " invariant default rule attributes";
+	invariantAttributes = toShared(equalAttributes.release());
+	return Invariance::PARTIALLY_INVARIANT;
 }
 
+
+namespace {
+
 bool evaluateDefaultRuleAttributes(
 		const GU_Detail* detail,
 		ShapeData& shapeData,
 		const ShapeConverterUPtr& shapeConverter,
-		const PRTContextUPtr& prtCtx
+		const PRTContextUPtr& prtCtx,
+		bool shareInvariantDefaults
 ) {
 	WA("all");
 
 	assert(shapeData.isValid());
 
-	// setup encoder options for attribute evaluation encoder
-	constexpr const wchar_t* encs[] = { ENCODER_ID_CGA_EVALATTR };
-	constexpr size_t encsCount = sizeof(encs) / sizeof(encs[0]);
-	const AttributeMapUPtr encOpts = getValidEncoderInfo(ENCODER_ID_CGA_EVALATTR);
-	const prt::AttributeMap* encsOpts[] = { encOpts.get() };
+	DefaultAttributeCache& cache = *prtCtx->mDefaultAttributeCache;
+	AttributeMapBuilderVector& ruleAttributeBuilders = shapeData.getRuleAttributeMapBuilders();
 
 	const size_t numShapes = shapeData.getInitialShapeBuilders().size();
 
 	// keep rule file info per initial shape to filter generated attributes
-	std::vector<RuleFileInfoUPtr> ruleFileInfos(numShapes);
+	RuleFileInfoVector ruleFileInfos;
+	ruleFileInfos.reserve(numShapes);
+
+	std::vector<DefaultAttributeCache::ShapeKey> shapeKeys;
+	shapeKeys.reserve(numShapes);
+
+	// the cache keys do not identify the resolve map, see PRTContext::runIfCurrent for inserts
+	std::vector<ResolveMapSPtr> resolveMaps;
+	resolveMaps.reserve(numShapes);
+
+	std::vector<size_t> pendingShapes; // initial shapes which need to be evaluated by generate
 
 	// create initial shapes
 	// loop over all initial shapes and use the first primitive to get the attribute values
@@ -96,41 +247,86 @@ bool evaluateDefaultRuleAttributes(
 			return false;
 		}
 
-		ruleFileInfos[isIdx] = getRuleFileInfo(ma, resolveMap, prtCtx->mPRTCache.get());
+		const RuleFileInfoCache::EntrySPtr ruleFileInfo = prtCtx->getRuleFileInfo(ma.mRPK, resolveMap, ma.mRuleFile);
 
 		const std::wstring shapeName = L"shape_" + std::to_wstring(isIdx);
 		if (DBG) LOG_DBG << "evaluating attrs for shape: " << shapeName;
 
+		const int32_t randomSeed = shapeData.getInitialShapeRandomSeed(isIdx);
+
+		// try to reuse previously evaluated default rule attributes
+		const DefaultAttributeCache::ShapeKey shapeKey = {
+			{ ma.mRPK.string(), ma.mRuleFile, ma.mStyle, ma.mStartRule },
+			randomSeed,
+			shapeData.getInitialShapeGeometryHash(isIdx)
+		};
+
+		AttributeMapSPtr defaults = cache.get(shapeKey);
+		AttributeMapSPtr invariantDefaults; // the subset of the defaults which is shared by all shapes of the rule
+		if (!defaults && shareInvariantDefaults) {
+			auto invariance = cache.getInvariance(shapeKey.ruleKey, invariantDefaults);
+			if (invariance == DefaultAttributeCache::Invariance::UNKNOWN) {
+				invariance = evaluateInvariance(ma, resolveMap, ruleFileInfo, prtCtx, invariantDefaults);
+				prtCtx->runIfCurrent(ma.mRPK, resolveMap, [&cache, &shapeKey, invariance, &invariantDefaults]() {
+					cache.setInvariance(shapeKey.ruleKey, invariance, invariantDefaults);
+				});
+			}
+			if (invariance == DefaultAttributeCache::Invariance::INVARIANT)
+				defaults = std::move(invariantDefaults);
+		}
+
 		// persist rule attributes even if empty (need to live until prt::generate is done)
-		AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+		// shared defaults are passed as rule attributes, generate then only needs to evaluate the remaining ones
+		AttributeMapBuilderUPtr amb(invariantDefaults
+		                            ? prt::AttributeMapBuilder::createFromAttributeMap(invariantDefaults.get())
+		                            : prt::AttributeMapBuilder::create());
 		AttributeMapUPtr ruleAttr(amb->createAttributeMap());
 
 		auto& isb = shapeData.getInitialShapeBuilder(isIdx);
 		isb->setAttributes(
 				ma.mRuleFile.c_str(),
 				ma.mStartRule.c_str(),
-				shapeData.getInitialShapeRandomSeed(isIdx),
+				randomSeed,
 				shapeName.c_str(),
 				ruleAttr.get(),
 				resolveMap.get());
 
 		prt::Status status = prt::STATUS_UNSPECIFIED_ERROR;
 		const prt::InitialShape* initialShape = isb->createInitialShapeAndReset(&status);
-		if (status == prt::STATUS_OK && initialShape != nullptr) {
-			shapeData.addShape(initialShape, std::move(amb), std::move(ruleAttr));
-		}
-		else
+		if (status != prt::STATUS_OK || initialShape == nullptr) {
 			LOG_WRN << "failed to create initial shape " << shapeName << ": " << prt::getStatusDescription(status);
+			continue;
+		}
+
+		const size_t shapeIdx = shapeData.getInitialShapes().size();
+		shapeData.addShape(initialShape, std::move(amb), std::move(ruleAttr));
+		ruleFileInfos.push_back(ruleFileInfo);
+		shapeKeys.push_back(shapeKey);
+		resolveMaps.push_back(resolveMap);
+
+		if (defaults) {
+			setDefaultAttributes(ruleAttributeBuilders[shapeIdx], defaults);
+			continue;
+		}
+
+		pendingShapes.push_back(shapeIdx);
 	}
 	assert(shapeData.isValid());
 
-	// run generate to evaluate default rule attributes
-	AttrEvalCallbacks aec(shapeData.getRuleAttributeMapBuilders(), ruleFileInfos);
-	const InitialShapeNOPtrVector& is = shapeData.getInitialShapes();
-	const prt::Status stat = prt::generate(is.data(), is.size(), nullptr, encs, encsCount, encsOpts, &aec,
-	                                       prtCtx->mPRTCache.get(), nullptr, nullptr, nullptr);
-	if (stat != prt::STATUS_OK) {
-		LOG_ERR << "assign: prt::generate() failed with status: '" << prt::getStatusDescription(stat) << "' (" << stat << ")";
+	if (DBG) LOG_DBG << "default rule attributes: " << shapeKeys.size() - pendingShapes.size() << " reused, "
+	                 << pendingShapes.size() << " to evaluate";
+
+	// run generate to evaluate the remaining default rule attributes and remember them for the next cook
+	const bool success = generateDefaultAttributes(shapeData.getInitialShapes(), pendingShapes, ruleAttributeBuilders,
+	                                               ruleFileInfos, prtCtx);
+	if (success) {
+		for (size_t shapeIdx: pendingShapes) {
+			const DefaultAttributeCache::ShapeKey& shapeKey = shapeKeys[shapeIdx];
+			const AttributeMapSPtr defaults = toShared(ruleAttributeBuilders[shapeIdx]->createAttributeMap());
+			prtCtx->runIfCurrent(shapeKey.ruleKey.rpk, resolveMaps[shapeIdx], [&cache, &shapeKey, &defaults]() {
+				cache.insert(shapeKey, defaults);
+			});
+		}
 	}
 
 	assert(shapeData.isValid());
@@ -145,7 +341,7 @@ SOPAssign::SOPAssign(const PRTContextUPtr& pCtx, OP_Network* net, const char* na
 : SOP_Node(net, name, op), mPRTCtx(pCtx), mShapeConverter(new ShapeConverter()) { }
 
 OP_ERROR SOPAssign::cookMySop(OP_Context& context) {
-	WA_NEW_LAP
+	const TraceFileUpdate traceFileUpdate(mPRTCtx); // after the cook scope below has been recorded
 	WA("all");
 
 	if (lockInputs(context) >= UT_ERROR_ABORT) {
@@ -162,12 +358,14 @@ OP_ERROR SOPAssign::cookMySop(OP_Context& context) {
 
 		ShapeData shapeData;
 		mShapeConverter->get(gdp, primCls, shapeData, mPRTCtx);
-		const bool canContinue = evaluateDefaultRuleAttributes(gdp, shapeData, mShapeConverter, mPRTCtx);
+		const bool shareInvariantDefaults = AssignNodeParams::getShareInvariantDefaults(this, context.getTime());
+		const bool canContinue = evaluateDefaultRuleAttributes(gdp, shapeData, mShapeConverter, mPRTCtx, shareInvariantDefaults);
 		if (!canContinue) {
 			LOG_ERR << getName() << ": aborting, could not successfully evaluate default rule attributes";
 			return UT_ERROR_ABORT;
 		}
-		mShapeConverter->put(gdp, primCls, shapeData);
+		const auto floatPrecision = AssignNodeParams::getFloatPrecision(this, context.getTime());
+		mShapeConverter->put(gdp, primCls, shapeData, floatPrecision);
 	}
 
 	unlockInputs();
@@ -181,4 +379,18 @@ void SOPAssign::opChanged(OP_EventType reason, void *data) {
    // trigger recook on name change, we use the node name in various output places
    if (reason == OP_NAME_CHANGED)
 	   forceRecook();
+
+   // start unpacking a new rule package right away instead of at cook time
+   else if (reason == OP_PARM_CHANGED) {
+	   const int parmIndex = static_cast<int>(reinterpret_cast<intptr_t>(data));
+	   if (parmIndex == getParmList()->getParmIndex(AssignNodeParams::RPK.getToken()))
+		   mPRTCtx->prefetchResolveMap(AssignNodeParams::getRPK(this, CHgetEvalTime()));
+   }
+}
+
+void SOPAssign::finishedLoadingNetwork(bool isChildCall) {
+	SOP_Node::finishedLoadingNetwork(isChildCall);
+
+	// unpack the rule packages of a loaded scene while the rest of it is set up
+	mPRTCtx->prefetchResolveMap(AssignNodeParams::getRPK(this, CHgetEvalTime()));
 }
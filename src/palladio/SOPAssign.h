@@ -18,6 +18,8 @@
 
 #include "PRTContext.h"
 #include "ShapeConverter.h"
+#include "DefaultAttributeCache.h"
+#include "RuleFileInfoCache.h"
 
 #include "SOP/SOP_Node.h"
 
@@ -31,6 +33,7 @@ public:
 	const PLD_BOOST_NS::filesystem::path& getRPK() const { return mShapeConverter->mDefaultMainAttributes.mRPK; }
 
 	void opChanged(OP_EventType reason, void* data = nullptr) override;
+	void finishedLoadingNetwork(bool isChildCall = false) override;
 
 protected:
 	OP_ERROR cookMySop(OP_Context& context) override;
@@ -39,3 +42,10 @@ private:
 	const PRTContextUPtr& mPRTCtx;
 	ShapeConverterUPtr    mShapeConverter;
 };
+
+/**
+ * probes the default rule attributes of a rule for invariance, see DefaultAttributeCache
+ */
+PLD_TEST_EXPORTS_API DefaultAttributeCache::Invariance evaluateInvariance(
+		const MainAttributes& ma, const ResolveMapSPtr& resolveMap, const RuleFileInfoCache::EntrySPtr& ruleFileInfo,
+		const PRTContextUPtr& prtCtx, DefaultAttributeCache::AttributeMapSPtr& invariantAttributes);
@@ -20,12 +20,14 @@
 #include "ShapeData.h"
 #include "PrimitiveClassifier.h"
 #include "ModelConverter.h"
-#include "MultiWatch.h"
+#include "BatchGenerate.h"
+#include "Tracer.h"
 
+#include "SOP/SOP_Error.h"
 #include "UT/UT_Interrupt.h"
 
-#include <future>
 #include <algorithm>
+#include <chrono>
 
 
 namespace {
@@ -38,6 +40,46 @@ constexpr const wchar_t* ENCODER_ID_CGA_PRINT = L"com.esri.prt.core.CGAPrintEnco
 
 const PrimitiveClassifier DEFAULT_PRIMITIVE_CLASSIFIER;
 
+constexpr size_t MAX_NODE_WARNINGS = 10;
+
+const UT_String PLD_STATS_OCCLUSION_TIME = "pldStatsOcclusionTime";
+const UT_String PLD_STATS_GENERATE_TIME  = "pldStatsGenerateTime";
+const UT_String PLD_STATS_INITIAL_SHAPES = "pldStatsInitialShapes";
+const UT_String PLD_STATS_THREADS        = "pldStatsThreads";
+
+double getSecondsSince(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the per initial shape statistics are added as primitive attributes by ModelConverter
+void addGenerateStatistics(GU_Detail* detail, double occlusionTime, double generateTime, size_t numShapes, size_t numThreads) {
+	GA_RWHandleD(detail->addFloatTuple(GA_ATTRIB_DETAIL, PLD_STATS_OCCLUSION_TIME, 1, GA_Defaults(0.0), nullptr, nullptr, GA_STORE_REAL64)).set(GA_Offset(0), occlusionTime);
+	GA_RWHandleD(detail->addFloatTuple(GA_ATTRIB_DETAIL, PLD_STATS_GENERATE_TIME, 1, GA_Defaults(0.0), nullptr, nullptr, GA_STORE_REAL64)).set(GA_Offset(0), generateTime);
+	GA_RWHandleI(detail->addIntTuple(GA_ATTRIB_DETAIL, PLD_STATS_INITIAL_SHAPES, 1)).set(GA_Offset(0), static_cast<int32>(numShapes));
+	GA_RWHandleI(detail->addIntTuple(GA_ATTRIB_DETAIL, PLD_STATS_THREADS, 1)).set(GA_Offset(0), static_cast<int32>(numThreads));
+}
+
+// forwards the distinct generate messages of all converters to the node warnings, the complete list is in the log
+void addGenerateWarnings(SOP_Node* node, const std::vector<ModelConverterUPtr>& converters) {
+	ModelConverter::MessageCounts messages;
+	for (const auto& mc: converters) {
+		for (const auto& m: mc->getMessages())
+			messages[m.first] += m.second;
+	}
+
+	size_t n = 0;
+	for (const auto& m: messages) {
+		if (n++ == MAX_NODE_WARNINGS) {
+			node->addWarning(SOP_MESSAGE, "... more CGA errors and warnings in the log");
+			break;
+		}
+		std::string w = toOSNarrowFromUTF16(m.first);
+		if (m.second > 1)
+			w.append(" (").append(std::to_string(m.second)).append("x)");
+		node->addWarning(SOP_MESSAGE, w.c_str());
+	}
+}
+
 } // namespace
 
 
@@ -64,11 +106,13 @@ bool SOPGenerate::handleParams(OP_Context& context) {
 	const bool emitAttributes = (evalInt(GenerateNodeParams::EMIT_ATTRS.getToken(), 0, now) > 0);
 	const bool emitMaterial   = (evalInt(GenerateNodeParams::EMIT_MATERIAL.getToken(), 0, now) > 0);
 	const bool emitReports    = (evalInt(GenerateNodeParams::EMIT_REPORTS.getToken(), 0, now) > 0);
+	const bool emitStatistics = (evalInt(GenerateNodeParams::EMIT_STATISTICS.getToken(), 0, now) > 0);
 
 	AttributeMapBuilderUPtr optionsBuilder(prt::AttributeMapBuilder::create());
 	optionsBuilder->setBool(EO_EMIT_ATTRIBUTES, emitAttributes);
 	optionsBuilder->setBool(EO_EMIT_MATERIALS, emitMaterial);
 	optionsBuilder->setBool(EO_EMIT_REPORTS, emitReports);
+	optionsBuilder->setBool(EO_EMIT_STATISTICS, emitStatistics);
 	AttributeMapUPtr encoderOptions(optionsBuilder->createAttributeMapAndReset());
 	mHoudiniEncoderOptions.reset(createValidatedOptions(ENCODER_ID_HOUDINI, encoderOptions.get()));
 	if (!mHoudiniEncoderOptions)
@@ -80,69 +124,8 @@ bool SOPGenerate::handleParams(OP_Context& context) {
 	return true;
 }
 
-namespace {
-
-enum class BatchMode { OCCLUSION, GENERATION };
-const std::vector<std::string> BATCH_MODE_NAMES = { "occlusion", "generation" };
-
-std::vector<prt::Status> batchGenerate(BatchMode mode,
-                                       size_t nThreads,
-                                       std::vector<ModelConverterUPtr>& hg,
-                                       size_t isRangeSize,
-                                       const InitialShapeNOPtrVector& is,
-                                       const std::vector<const wchar_t*>& allEncoders,
-                                       const AttributeMapNOPtrVector& allEncoderOptions,
-                                       std::vector<prt::OcclusionSet::Handle>& occlusionHandles,
-                                       OcclusionSetUPtr& occlusionSet,
-                                       CacheObjectUPtr& prtCache,
-                                       const AttributeMapUPtr& genOpts)
-{
-	std::vector<prt::Status> batchStatus(nThreads, prt::STATUS_UNSPECIFIED_ERROR);
-
-	std::vector<std::future<void>> futures;
-	futures.reserve(nThreads);
-	for (int8_t ti = 0; ti < nThreads; ti++) {
-		auto f = std::async(std::launch::async, [&,ti] { // capture thread index by value, else we have is range chaos
-			const size_t isStartPos = ti * isRangeSize;
-			const size_t isPastEndPos = (ti < nThreads - 1) ? (ti + 1) * isRangeSize : is.size();
-			const size_t isActualRangeSize = isPastEndPos - isStartPos;
-			const auto isRangeStart = &is[isStartPos];
-			const auto isOcclRangeStart = &occlusionHandles[isStartPos];
-
-			LOG_DBG << "thread " << ti << ": #is = " << isActualRangeSize;
-
-			switch (mode) {
-				case BatchMode::OCCLUSION: {
-					batchStatus[ti] = prt::generateOccluders(isRangeStart, isActualRangeSize, isOcclRangeStart,
-					                                         nullptr, 0, nullptr, hg[ti].get(), prtCache.get(),
-					                                         occlusionSet.get(), genOpts.get());
-					break;
-				}
-				case BatchMode::GENERATION: {
-					batchStatus[ti] = prt::generate(isRangeStart, isActualRangeSize, isOcclRangeStart,
-					                                allEncoders.data(), allEncoders.size(), allEncoderOptions.data(),
-					                                hg[ti].get(), prtCache.get(), occlusionSet.get(), genOpts.get());
-					break;
-				}
-			}
-
-			if (batchStatus[ti] != prt::STATUS_OK) {
-			    LOG_WRN << "batch mode " << BATCH_MODE_NAMES[(int)mode] << " failed with status: '"
-			            << prt::getStatusDescription(batchStatus[ti]) << "' ("
-			            << batchStatus[ti] << ")";
-			}
-
-		});
-		futures.emplace_back(std::move(f));
-	}
-	std::for_each(futures.begin(), futures.end(), [](std::future<void>& f) { f.wait(); });
-
-	return batchStatus;
-}
-
-} // namespace
-
 OP_ERROR SOPGenerate::cookMySop(OP_Context& context) {
+	const TraceFileUpdate traceFileUpdate(mPRTCtx); // after the cook scope below has been recorded
 	WA("all");
 
 	if (!handleParams(context))
@@ -159,6 +142,7 @@ OP_ERROR SOPGenerate::cookMySop(OP_Context& context) {
 	UT_AutoInterrupt progress("Generating CityEngine geometry...");
 
 	const auto groupCreation = GenerateNodeParams::getGroupCreation(this, context.getTime());
+	const auto attributeStorage = GenerateNodeParams::getAttributeStorage(this, context.getTime());
 	ShapeData shapeData(groupCreation, toUTF16FromOSNarrow(getName().toStdString()));
 
 	ShapeGenerator shapeGen;
@@ -172,7 +156,7 @@ OP_ERROR SOPGenerate::cookMySop(OP_Context& context) {
 
 	// establish threads
 	const size_t nThreads = std::min<size_t>(mPRTCtx->mCores, is.size());
-	const size_t isRangeSize = std::ceil(is.size() / nThreads);
+	const size_t isRangeSize = getBatchRangeSize(is.size(), nThreads);
 
 	// prepare generate status receivers
 	std::vector<prt::Status> initialShapeStatus(is.size(), prt::STATUS_OK);
@@ -184,29 +168,39 @@ OP_ERROR SOPGenerate::cookMySop(OP_Context& context) {
 
 			// prt requires one callback instance per generate call
 			std::vector<ModelConverterUPtr> hg(nThreads);
-			std::generate(hg.begin(), hg.end(), [this, &groupCreation, &initialShapeStatus, &progress]() -> ModelConverterUPtr {
-				return ModelConverterUPtr(new ModelConverter(gdp, groupCreation, initialShapeStatus, &progress));
+			std::generate(hg.begin(), hg.end(), [this, &groupCreation, &initialShapeStatus, &progress, &attributeStorage]() -> ModelConverterUPtr {
+				return ModelConverterUPtr(new ModelConverter(gdp, groupCreation, initialShapeStatus, &progress, attributeStorage));
 			});
 
+			std::vector<prt::Callbacks*> callbacks(hg.size());
+			std::transform(hg.begin(), hg.end(), callbacks.begin(), [](const ModelConverterUPtr& mc) { return mc.get(); });
+
 			std::vector<prt::OcclusionSet::Handle> occlusionHandles(is.size());
 			OcclusionSetUPtr occlusionSet{prt::OcclusionSet::create()};
 
 			LOG_INF << getName() << ": calling generate: #initial shapes = " << is.size() << ", #threads = "
 			        << nThreads << ", initial shapes per thread = " << isRangeSize;
 
-			batchGenerate(BatchMode::OCCLUSION, nThreads, hg, isRangeSize, is, mAllEncoders, mAllEncoderOptions,
-			              occlusionHandles, occlusionSet, mPRTCtx->mPRTCache, mGenerateOptions);
+			const auto occlusionStart = std::chrono::steady_clock::now();
+			batchGenerate(BatchMode::OCCLUSION, nThreads, callbacks, isRangeSize, is, mAllEncoders, mAllEncoderOptions,
+			              occlusionHandles.data(), occlusionSet.get(), mPRTCtx->mPRTCache.get(), mGenerateOptions.get());
+			const double occlusionTime = getSecondsSince(occlusionStart);
 
-			batchGenerate(BatchMode::GENERATION, nThreads, hg, isRangeSize, is, mAllEncoders, mAllEncoderOptions,
-			              occlusionHandles, occlusionSet, mPRTCtx->mPRTCache, mGenerateOptions);
+			const auto generateStart = std::chrono::steady_clock::now();
+			batchGenerate(BatchMode::GENERATION, nThreads, callbacks, isRangeSize, is, mAllEncoders, mAllEncoderOptions,
+			              occlusionHandles.data(), occlusionSet.get(), mPRTCtx->mPRTCache.get(), mGenerateOptions.get());
+			const double generateTime = getSecondsSince(generateStart);
+
+			if (mHoudiniEncoderOptions->getBool(EO_EMIT_STATISTICS))
+				addGenerateStatistics(gdp, occlusionTime, generateTime, is.size(), nThreads);
 
 			occlusionSet->dispose(occlusionHandles.data(), occlusionHandles.size());
+
+			addGenerateWarnings(this, hg);
 		}
 		select();
 	}
 
-	WA_PRINT_TIMINGS
-
 	unlockInputs();
 
 	// generate status check: if all shapes fail, we abort cooking (failure of individual shapes is sometimes expected)
@@ -19,18 +19,23 @@
 #include "PrimitiveClassifier.h"
 #include "AttributeConversion.h"
 #include "LogHandler.h"
-#include "MultiWatch.h"
+#include "Tracer.h"
 
 #include "GU/GU_Detail.h"
 #include "GA/GA_PageHandle.h"
+#include "GA/GA_SplittableRange.h"
 #include "GEO/GEO_PrimPolySoup.h"
 #include "UT/UT_String.h"
+#include "UT/UT_ParallelUtil.h"
 
 #include "BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/variant.hpp)
 #include PLD_BOOST_INCLUDE(/algorithm/string.hpp)
 #include PLD_BOOST_INCLUDE(/functional/hash.hpp)
 
+#include <algorithm>
+#include <unordered_map>
+
 
 namespace {
 
@@ -54,10 +59,54 @@ struct ConversionHelper {
 		uvSets.resize(uvHandles.size());
 	}
 
-	InitialShapeBuilderUPtr createInitialShape() const {
+	// pre-size the buffers from the (estimated) number of faces and vertices of an initial shape
+	void reserve(size_t faceCount, size_t vertexCount) {
+		faceCounts.reserve(faceCount);
+		indices.reserve(vertexCount);
+		for (size_t u = 0; u < uvHandles.size(); u++) {
+			if (uvHandles[u].isInvalid())
+				continue;
+			uvSets[u].uvs.reserve(2 * vertexCount);
+			uvSets[u].idx.reserve(vertexCount);
+		}
+	}
+
+	// only pass the points actually used by this shape to PRT (instead of all points of the detail)
+	void compactVertices(std::vector<double>& localCoords, std::vector<uint32_t>& localIndices) const {
+		std::vector<uint32_t> usedPoints(indices);
+		std::sort(usedPoints.begin(), usedPoints.end());
+		usedPoints.erase(std::unique(usedPoints.begin(), usedPoints.end()), usedPoints.end());
+
+		localCoords.resize(3 * usedPoints.size());
+		for (size_t i = 0; i < usedPoints.size(); i++) {
+			const size_t gi = 3 * static_cast<size_t>(usedPoints[i]);
+			localCoords[3 * i + 0] = coords[gi + 0];
+			localCoords[3 * i + 1] = coords[gi + 1];
+			localCoords[3 * i + 2] = coords[gi + 2];
+		}
+
+		localIndices.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); i++) {
+			const auto it = std::lower_bound(usedPoints.begin(), usedPoints.end(), indices[i]);
+			localIndices[i] = static_cast<uint32_t>(std::distance(usedPoints.begin(), it));
+		}
+	}
+
+	InitialShapeBuilderUPtr createInitialShape(size_t& geometryHash) const {
 		InitialShapeBuilderUPtr isb(prt::InitialShapeBuilder::create());
 
-		isb->setGeometry(coords.data(), coords.size(), indices.data(), indices.size(),
+		std::vector<double> localCoords;
+		std::vector<uint32_t> localIndices;
+		compactVertices(localCoords, localIndices);
+
+		// identifies the shape geometry, e.g. for caching of evaluated default rule attributes
+		geometryHash = 0;
+		PLD_BOOST_NS::hash_range(geometryHash, localCoords.begin(), localCoords.end());
+		PLD_BOOST_NS::hash_range(geometryHash, localIndices.begin(), localIndices.end());
+		PLD_BOOST_NS::hash_range(geometryHash, faceCounts.begin(), faceCounts.end());
+		PLD_BOOST_NS::hash_range(geometryHash, holes.begin(), holes.end());
+
+		isb->setGeometry(localCoords.data(), localCoords.size(), localIndices.data(), localIndices.size(),
 		                 faceCounts.data(), faceCounts.size(), holes.data(), holes.size());
 
 		for (size_t u = 0; u < uvHandles.size(); u++) {
@@ -124,13 +173,11 @@ std::array<double, 3> getCentroid(const std::vector<double>& coords, const Conve
 
 // try to get random seed from incoming primitive attributes (important for default rule attr eval)
 // use centroid based hash as fallback
-int32_t getRandomSeed(const GA_Detail* detail, const GA_Offset& primOffset, const std::vector<double>& coords,
+int32_t getRandomSeed(const GA_ROHandleI& seedH, const GA_Offset& primOffset, const std::vector<double>& coords,
                       const ConversionHelper& ch) {
 	int32_t randomSeed = 0;
 
-	GA_ROAttributeRef seedRef(detail->findPrimitiveAttribute(PLD_RANDOM_SEED));
-	if (!seedRef.isInvalid() && (seedRef->getStorageClass() == GA_STORECLASS_INT)) { // TODO: check for 32bit
-		GA_ROHandleI seedH(seedRef);
+	if (seedH.isValid()) {
 		randomSeed = seedH.get(primOffset);
 	}
 	else {
@@ -170,6 +217,19 @@ struct MainAttributeHandles {
 		GA_RWAttributeRef seedRef(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, PLD_RANDOM_SEED, 1, GA_Defaults(0), nullptr, nullptr, GA_STORE_INT32));
 		seed.bind(seedRef);
 	}
+
+	// default values (from node parameters), converted once
+	UT_StringHolder defaultRPK;
+	UT_StringHolder defaultRuleFile;
+	UT_StringHolder defaultStartRule;
+	UT_StringHolder defaultStyle;
+
+	void setDefaults(const MainAttributes& ma) {
+		defaultRPK       = ma.mRPK.string();
+		defaultRuleFile  = toOSNarrowFromUTF16(ma.mRuleFile);
+		defaultStartRule = toOSNarrowFromUTF16(ma.mStartRule);
+		defaultStyle     = toOSNarrowFromUTF16(ma.mStyle);
+	}
 };
 
 void ShapeConverter::get(const GU_Detail* detail, const PrimitiveClassifier& primCls,
@@ -182,19 +242,26 @@ void ShapeConverter::get(const GU_Detail* detail, const PrimitiveClassifier& pri
 	// -- partition primitives into initial shapes by primitive classifier values
 	PrimitivePartition primPart(detail, primCls);
 	const PrimitivePartition::PartitionMap& partitions = primPart.get();
+	shapeData.setClassifierNames(primPart.getClassifierNames());
 
-	// -- copy all coordinates
+	// -- copy all coordinates (indexed by point index, gathered page-wise in parallel)
 	std::vector<double> coords;
 	assert(detail->getPointRange().getEntries() == detail->getNumPoints());
-	coords.reserve(detail->getNumPoints()*3);
-	GA_Offset ptoff;
-	GA_FOR_ALL_PTOFF(detail, ptoff) {
-		const UT_Vector3 p = detail->getPos3(ptoff);
-		if (DBG) LOG_DBG << "coords " << coords.size()/3 << ": " << p.x() << ", " << p.y() << ", " << p.z();
-		coords.push_back(static_cast<double>(p.x()));
-		coords.push_back(static_cast<double>(p.y()));
-		coords.push_back(static_cast<double>(p.z()));
-	}
+	coords.resize(detail->getNumPoints()*3);
+	UTparallelFor(GA_SplittableRange(detail->getPointRange()), [detail, &coords](const GA_SplittableRange& r) {
+		GA_ROPageHandleV3 posH(detail->getP());
+		GA_Offset start, end;
+		for (GA_Iterator it(r); it.blockAdvance(start, end);) {
+			posH.setPage(start);
+			for (GA_Offset ptoff = start; ptoff < end; ++ptoff) {
+				const UT_Vector3& p = posH.get(ptoff);
+				const size_t pi = static_cast<size_t>(detail->pointIndex(ptoff));
+				coords[3 * pi + 0] = static_cast<double>(p.x());
+				coords[3 * pi + 1] = static_cast<double>(p.y());
+				coords[3 * pi + 2] = static_cast<double>(p.z());
+			}
+		}
+	});
 
 	// scan for uv attributes
 	std::vector<GA_ROHandleV2D> uvHandles(UV_ATTR_NAMES.size());
@@ -204,51 +271,120 @@ void ShapeConverter::get(const GU_Detail* detail, const PrimitiveClassifier& pri
 		uvHandles[uvSet].bind(attrib);
 	}
 
-	// -- loop over all primitive partitions and create shape builders
-	uint32_t isIdx = 0;
-	for (auto pIt = partitions.cbegin(); pIt != partitions.cend(); ++pIt, ++isIdx) {
-		if (DBG) LOG_DBG << "   -- creating initial shape " << isIdx << ", prim count = " << pIt->second.size();
-
-		ConversionHelper ch(coords, uvHandles);
+	// resolve optional random seed attribute once for all initial shapes
+	GA_ROHandleI seedH;
+	const GA_ROAttributeRef seedRef(detail->findPrimitiveAttribute(PLD_RANDOM_SEED));
+	if (seedRef.isValid() && (seedRef->getStorageClass() == GA_STORECLASS_INT)) // TODO: check for 32bit
+		seedH.bind(seedRef.get());
+
+	// -- convert all primitive partitions in parallel, each worker uses its own conversion helper
+	std::vector<PrimitivePartition::PartitionMap::const_iterator> partitionIts;
+	partitionIts.reserve(partitions.size());
+	for (auto pIt = partitions.cbegin(); pIt != partitions.cend(); ++pIt)
+		partitionIts.push_back(pIt);
+
+	std::vector<InitialShapeBuilderUPtr> builders(partitionIts.size());
+	std::vector<int32_t> randomSeeds(partitionIts.size(), 0);
+	std::vector<size_t> geometryHashes(partitionIts.size(), 0);
+	UTparallelForEachNumber(partitionIts.size(), [&](const UT_BlockedRange<size_t>& r) {
+		for (size_t isIdx = r.begin(); isIdx < r.end(); ++isIdx) {
+			const auto& primitives = partitionIts[isIdx]->second;
+			if (DBG) LOG_DBG << "   -- creating initial shape " << isIdx << ", prim count = " << primitives.size();
+
+			ConversionHelper ch(coords, uvHandles);
+
+			size_t vertexCount = 0;
+			for (const auto& prim: primitives)
+				vertexCount += prim->getVertexCount();
+			ch.reserve(primitives.size(), vertexCount);
+
+			// merge primitive geometry inside partition (potential multi-polygon initial shape)
+			for (const auto& prim: primitives) {
+				if (DBG) LOG_DBG << "   -- prim index " << prim->getMapIndex() << ", type: " << prim->getTypeName() << ", id = " << prim->getTypeId().get();
+				const auto& primType = prim->getTypeId();
+				switch (primType.get()) {
+					case GA_PRIMPOLY:
+						convertPolygon(ch, *prim, uvHandles);
+						break;
+					case GA_PRIMPOLYSOUP:
+						for (GEO_PrimPolySoup::PolygonIterator pit(static_cast<const GEO_PrimPolySoup&>(*prim)); !pit.atEnd(); ++pit) {
+							convertPolygon(ch, pit, uvHandles);
+						}
+						break;
+					default:
+						if (DBG) LOG_DBG << "      ignoring primitive of type " << prim->getTypeName();
+						break;
+				}
+			} // for each primitive
 
-		// merge primitive geometry inside partition (potential multi-polygon initial shape)
-		for (const auto& prim: pIt->second) {
-			if (DBG) LOG_DBG << "   -- prim index " << prim->getMapIndex() << ", type: " << prim->getTypeName() << ", id = " << prim->getTypeId().get();
-			const auto& primType = prim->getTypeId();
-			switch (primType.get()) {
-				case GA_PRIMPOLY:
-					convertPolygon(ch, *prim, uvHandles);
-					break;
-				case GA_PRIMPOLYSOUP:
-					for (GEO_PrimPolySoup::PolygonIterator pit(static_cast<const GEO_PrimPolySoup&>(*prim)); !pit.atEnd(); ++pit) {
-						convertPolygon(ch, pit, uvHandles);
-					}
-					break;
-				default:
-					if (DBG) LOG_DBG << "      ignoring primitive of type " << prim->getTypeName();
-					break;
-			}
-		} // for each primitive
+			randomSeeds[isIdx] = getRandomSeed(seedH, primitives.front()->getMapOffset(), coords, ch);
+			builders[isIdx] = ch.createInitialShape(geometryHashes[isIdx]);
+		} // for each primitive partition
+	});
 
-		const int32_t randomSeed = getRandomSeed(detail, pIt->second.front()->getMapOffset(), coords, ch);
-		InitialShapeBuilderUPtr isb = ch.createInitialShape();
-		shapeData.addBuilder(std::move(isb), randomSeed, pIt->second, pIt->first);
-	} // for each primitive partition
+	// -- hand over shape builders in partition order
+	for (size_t isIdx = 0; isIdx < partitionIts.size(); isIdx++) {
+		const auto& pIt = partitionIts[isIdx];
+		shapeData.addBuilder(std::move(builders[isIdx]), randomSeeds[isIdx], geometryHashes[isIdx], pIt->second, pIt->first);
+	}
 
 	assert(shapeData.isValid());
 }
 
-void ShapeConverter::put(GU_Detail* detail, PrimitiveClassifier& primCls, const ShapeData& shapeData) const {
+namespace {
+
+// rule attribute handles, bound once per rule attribute name
+struct RuleAttributeHandles {
+	prt::AttributeMap::PrimitiveType type;
+	GA_RWHandleD                     floatHandle;
+	GA_RWHandleI                     boolHandle;
+	GA_RWBatchHandleS                stringHandle;
+};
+
+using OffsetRun = std::pair<GA_Offset, GA_Size>;
+
+// collect primitive offsets of an initial shape and merge them into contiguous runs for block writes
+void getOffsetRuns(const PrimitiveNOPtrVector& pv, GA_OffsetList& offsets, std::vector<OffsetRun>& runs) {
+	std::vector<GA_Offset> sorted;
+	sorted.reserve(pv.size());
+	for (const auto& prim: pv)
+		sorted.push_back(prim->getMapOffset());
+	std::sort(sorted.begin(), sorted.end());
+
+	offsets.clear();
+	runs.clear();
+	for (const GA_Offset& off: sorted) {
+		offsets.append(off);
+		if (!runs.empty() && (runs.back().first + runs.back().second == off))
+			runs.back().second++;
+		else
+			runs.emplace_back(off, 1);
+	}
+}
+
+template<typename H, typename V>
+void setRuns(const H& handle, const std::vector<OffsetRun>& runs, const V& value) {
+	for (const auto& r: runs)
+		handle.setBlock(r.first, r.second, &value, 0); // using stride = 0 to always set the same value
+}
+
+} // namespace
+
+void ShapeConverter::put(GU_Detail* detail, PrimitiveClassifier& primCls, const ShapeData& shapeData,
+                         AttributeConversion::FloatPrecision floatPrecision) const {
 	WA("all");
 
+	const GA_Storage floatStorage = (floatPrecision == AttributeConversion::FloatPrecision::DOUBLE) ? GA_STORE_REAL64 : GA_STORE_REAL32;
+
 	primCls.setupAttributeHandles(detail);
 
 	MainAttributeHandles mah;
 	mah.setup(detail);
+	mah.setDefaults(mDefaultMainAttributes);
 
 	// generate primitive attribute handles from all default rule attribute names from all initial shapes
 	AttributeMapVector defaultRuleAttributeMaps;
-	std::map<const wchar_t*, GA_RWAttributeRef> mAttrRefs; // key points to defaultRuleAttributeMaps
+	std::unordered_map<std::wstring, RuleAttributeHandles> ruleAttrHandles;
 	for (auto& amb: shapeData.getRuleAttributeMapBuilders()) {
 		defaultRuleAttributeMaps.emplace_back(amb->createAttributeMap());
 		const auto& dra = defaultRuleAttributeMaps.back();
@@ -259,37 +395,46 @@ void ShapeConverter::put(GU_Detail* detail, PrimitiveClassifier& primCls, const
 			const wchar_t* key = cKeys[k];
 
 			// make sure to only generate an attribute handle once
-			if (mAttrRefs.count(key) > 0)
+			auto it = ruleAttrHandles.find(key);
+			if (it != ruleAttrHandles.end())
 				continue;
 
-			const UT_String primAttrName = NameConversion::toPrimAttr(key);
+			const UT_StringHolder primAttrName = NameConversion::toPrimAttr(key);
 
-			GA_Attribute* primAttr = nullptr;
-			switch (dra->getType(key)) {
+			RuleAttributeHandles rah;
+			rah.type = dra->getType(key);
+			bool isValid = false;
+			switch (rah.type) {
 				case prt::AttributeMap::PT_FLOAT: {
-					primAttr = detail->addFloatTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1); // TODO: use double storage
+					rah.floatHandle.bind(detail->addFloatTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1, GA_Defaults(0.0), nullptr, nullptr, floatStorage));
+					isValid = rah.floatHandle.isValid();
 					break;
 				}
 				case prt::AttributeMap::PT_BOOL: {
-					primAttr = detail->addIntTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1); // TODO: use store type uint8
+					rah.boolHandle.bind(detail->addIntTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1)); // TODO: use store type uint8
+					isValid = rah.boolHandle.isValid();
 					break;
 				}
 				case prt::AttributeMap::PT_STRING: {
-					primAttr = detail->addStringTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1);
+					rah.stringHandle.bind(detail->addStringTuple(GA_ATTRIB_PRIMITIVE, primAttrName, 1));
+					isValid = rah.stringHandle.isValid();
 					break;
 				}
 				default:
 					break;
 			} // switch type
 
-			if (primAttr != nullptr)
-				mAttrRefs.emplace(key, primAttr);
+			if (isValid)
+				ruleAttrHandles.emplace(key, std::move(rah));
 			else
 				LOG_ERR << "Could not create primitive attribute handle: " << key << " -> " << primAttrName << " (type " << dra->getType(key) << ")";
 
 		} // for rule attribute
 	} // for each initial shape
 
+	const GA_IndexMap& primIndexMap = detail->getIndexMap(GA_ATTRIB_PRIMITIVE);
+	GA_OffsetList offsets;
+	std::vector<OffsetRun> runs;
 	for (size_t isIdx = 0; isIdx < shapeData.getRuleAttributeMapBuilders().size(); isIdx++) {
 		const auto& pv = shapeData.getPrimitiveMapping(isIdx);
 		const auto& defaultRuleAttributes = defaultRuleAttributeMaps[isIdx];
@@ -297,50 +442,54 @@ void ShapeConverter::put(GU_Detail* detail, PrimitiveClassifier& primCls, const
 
 		for (auto& prim: pv) {
 			primCls.put(prim);
-			putMainAttributes(detail, mah, prim);
+			putMainAttributes(mah, prim);
+		}
 
-			const GA_Offset& off = prim->getMapOffset();
+		getOffsetRuns(pv, offsets, runs);
+		setRuns(mah.seed, runs, randomSeed);
 
-			mah.seed.set(off, randomSeed);
+		const GA_Range shapeRange(primIndexMap, offsets);
 
-			size_t keyCount = 0;
-			const wchar_t* const* cKeys = defaultRuleAttributes->getKeys(&keyCount);
-			for (size_t k = 0; k < keyCount; k++) {
-				const wchar_t* const key = cKeys[k];
+		size_t keyCount = 0;
+		const wchar_t* const* cKeys = defaultRuleAttributes->getKeys(&keyCount);
+		for (size_t k = 0; k < keyCount; k++) {
+			const wchar_t* const key = cKeys[k];
 
-				const auto& attrRefIt = mAttrRefs.find(key);
-				if (attrRefIt == mAttrRefs.end())
-					continue;
-				const auto& attrRef = attrRefIt->second;
+			const auto& rahIt = ruleAttrHandles.find(key);
+			if (rahIt == ruleAttrHandles.end())
+				continue;
+			auto& rah = rahIt->second;
 
-				switch (defaultRuleAttributes->getType(key)) {
-					case prt::AttributeMap::PT_FLOAT: {
-						GA_RWHandleD av(attrRef);
-						if (av.isValid()) {
-							const double defVal = defaultRuleAttributes->getFloat(key);
-							av.set(off, defVal);
-						}
-						break;
-					}
-					case prt::AttributeMap::PT_BOOL: {
-						GA_RWHandleI av(attrRef);
-						const bool defVal = defaultRuleAttributes->getBool(key);
-						av.set(off, defVal ? 1 : 0);
-						break;
-					}
-					case prt::AttributeMap::PT_STRING: {
-						GA_RWHandleS av(attrRef);
-						const wchar_t* const defVal = defaultRuleAttributes->getString(key);
-						const std::string nDefVal = toOSNarrowFromUTF16(defVal); // !!!
-						av.set(off, nDefVal.c_str());
-						break;
-					}
-					default: {
-						LOG_ERR << "Array attribute support not implemented yet";
-					}
-				} // switch type
-			} // for default rule attribute keys
-		} // for all primitives in initial shape
+			// the handle type has been determined by the first occurrence of the rule attribute
+			const auto type = defaultRuleAttributes->getType(key);
+			if (type != rah.type) {
+				LOG_ERR << "Rule attribute " << key << " has conflicting types between initial shapes, skipping";
+				continue;
+			}
+
+			// convert the default value once per initial shape and write it to all its primitives
+			switch (type) {
+				case prt::AttributeMap::PT_FLOAT: {
+					const fpreal64 defVal = defaultRuleAttributes->getFloat(key);
+					setRuns(rah.floatHandle, runs, defVal);
+					break;
+				}
+				case prt::AttributeMap::PT_BOOL: {
+					const int32 defVal = defaultRuleAttributes->getBool(key) ? 1 : 0;
+					setRuns(rah.boolHandle, runs, defVal);
+					break;
+				}
+				case prt::AttributeMap::PT_STRING: {
+					const wchar_t* const defVal = defaultRuleAttributes->getString(key);
+					const UT_StringHolder nDefVal(toOSNarrowFromUTF16(defVal));
+					rah.stringHandle.set(shapeRange, 0, nDefVal);
+					break;
+				}
+				default: {
+					LOG_ERR << "Array attribute support not implemented yet";
+				}
+			} // switch type
+		} // for default rule attribute keys
 	} // for all initial shapes
 }
 
@@ -398,12 +547,15 @@ MainAttributes ShapeConverter::getMainAttributesFromPrimitive(const GU_Detail* d
 	return ma;
 }
 
-void ShapeConverter::putMainAttributes(const GU_Detail* detail, MainAttributeHandles& mah, const GA_Primitive* primitive) const {
-	MainAttributes ma = getMainAttributesFromPrimitive(detail, primitive);
-
+void ShapeConverter::putMainAttributes(MainAttributeHandles& mah, const GA_Primitive* primitive) const {
+	// main attributes which are already present on the primitive take precedence over the defaults
 	const GA_Offset& off = primitive->getMapOffset();
-	mah.rpk.set(off, ma.mRPK.string().c_str());
-	mah.ruleFile.set(off, toOSNarrowFromUTF16(ma.mRuleFile).c_str());
-	mah.startRule.set(off, toOSNarrowFromUTF16(ma.mStartRule).c_str());
-	mah.style.set(off, toOSNarrowFromUTF16(ma.mStyle).c_str());
+	if (!mah.rpk.get(off).isstring())
+		mah.rpk.set(off, mah.defaultRPK);
+	if (!mah.ruleFile.get(off).isstring())
+		mah.ruleFile.set(off, mah.defaultRuleFile);
+	if (!mah.startRule.get(off).isstring())
+		mah.startRule.set(off, mah.defaultStartRule);
+	if (!mah.style.get(off).isstring())
+		mah.style.set(off, mah.defaultStyle);
 }
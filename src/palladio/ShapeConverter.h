@@ -17,6 +17,7 @@
 #pragma once
 
 #include "PRTContext.h"
+#include "AttributeConversion.h"
 #include "Utils.h"
 
 #include "UT/UT_String.h"
@@ -32,7 +33,7 @@ class GA_Primitive;
 class OP_Context;
 class SOP_Node;
 class PrimitiveClassifier;
-class MainAttributeHandles;
+struct MainAttributeHandles;
 class ShapeData;
 
 const UT_String PLD_RPK         = "pldRPK";
@@ -50,15 +51,16 @@ struct MainAttributes {
 	std::wstring                   mStartRule;
 };
 
-class ShapeConverter {
+class PLD_TEST_EXPORTS_API ShapeConverter {
 public:
 	virtual void get(const GU_Detail* detail,  const PrimitiveClassifier& primCls,
 	                 ShapeData& shapeData, const PRTContextUPtr& prtCtx);
-	void put(GU_Detail* detail, PrimitiveClassifier& primCls, const ShapeData& shapeData) const;
+	void put(GU_Detail* detail, PrimitiveClassifier& primCls, const ShapeData& shapeData,
+	         AttributeConversion::FloatPrecision floatPrecision = AttributeConversion::FloatPrecision::SINGLE) const;
 
 	void getMainAttributes(SOP_Node* node, const OP_Context& context); // TODO: integrate into get
 	MainAttributes getMainAttributesFromPrimitive(const GU_Detail* detail, const GA_Primitive* prim) const;
-	void putMainAttributes(const GU_Detail* detail, MainAttributeHandles& mah, const GA_Primitive* primitive) const;
+	void putMainAttributes(MainAttributeHandles& mah, const GA_Primitive* primitive) const;
 
 public:
 	MainAttributes mDefaultMainAttributes;
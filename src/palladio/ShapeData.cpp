@@ -57,12 +57,13 @@ ShapeData::~ShapeData() {
 	});
 }
 
-void ShapeData::addBuilder(InitialShapeBuilderUPtr&& isb, int32_t randomSeed,
+void ShapeData::addBuilder(InitialShapeBuilderUPtr&& isb, int32_t randomSeed, size_t geometryHash,
                            const PrimitiveNOPtrVector& primMappings,
                            const PrimitivePartition::ClassifierValueType& clsVal)
 {
 	mInitialShapeBuilders.emplace_back(std::move(isb));
 	mRandomSeeds.push_back(randomSeed);
+	mGeometryHashes.push_back(geometryHash);
 	mPrimitiveMapping.emplace_back(primMappings);
 
 	if (mGroupCreation == GroupCreation::PRIMCLS) {
@@ -21,7 +21,7 @@
 #include "Utils.h"
 
 
-class ShapeData final {
+class PLD_TEST_EXPORTS_API ShapeData final {
 public:
 	ShapeData() = default;
 	ShapeData(const GroupCreation& gc, const std::wstring& namePrefix) : mGroupCreation(gc), mNamePrefix(namePrefix) { }
@@ -29,13 +29,14 @@ public:
 	ShapeData(ShapeData&&) = delete;
 	~ShapeData();
 
-	void addBuilder(InitialShapeBuilderUPtr&& isb, int32_t randomSeed, const PrimitiveNOPtrVector& primMappings,
-	                const PrimitivePartition::ClassifierValueType& clsVal);
+	void addBuilder(InitialShapeBuilderUPtr&& isb, int32_t randomSeed, size_t geometryHash,
+	                const PrimitiveNOPtrVector& primMappings, const PrimitivePartition::ClassifierValueType& clsVal);
 
 	void addShape(const prt::InitialShape* is, AttributeMapBuilderUPtr&& amb, AttributeMapUPtr&& ruleAttr);
 
 	InitialShapeBuilderVector& getInitialShapeBuilders() { return mInitialShapeBuilders; }
 	int32_t getInitialShapeRandomSeed(size_t isIdx) const { return mRandomSeeds[isIdx]; }
+	size_t getInitialShapeGeometryHash(size_t isIdx) const { return mGeometryHashes[isIdx]; }
 	InitialShapeBuilderUPtr& getInitialShapeBuilder(size_t isIdx) { return mInitialShapeBuilders[isIdx]; }
 	const PrimitiveNOPtrVector& getPrimitiveMapping(size_t isIdx) const { return mPrimitiveMapping[isIdx]; }
 
@@ -45,6 +46,9 @@ public:
 	const std::wstring& getInitialShapeName(size_t isIdx) const;
 	const InitialShapeNOPtrVector& getInitialShapes() const { return mInitialShapes; }
 
+	void setClassifierNames(const PrimitivePartition::ClassifierNames& names) { mClassifierNames = names; }
+	const PrimitivePartition::ClassifierNames& getClassifierNames() const { return mClassifierNames; }
+
 	bool isValid() const;
 
 private:
@@ -61,4 +65,7 @@ private:
 	std::wstring                      mNamePrefix;
 
 	std::vector<int32_t>              mRandomSeeds;
+	std::vector<size_t>               mGeometryHashes;
+
+	PrimitivePartition::ClassifierNames mClassifierNames;
 };
@@ -20,17 +20,19 @@
 #include "PrimitiveClassifier.h"
 #include "AttributeConversion.h"
 #include "LogHandler.h"
-#include "MultiWatch.h"
+#include "Tracer.h"
 
 #include "GA/GA_Primitive.h"
 #include "GU/GU_Detail.h"
 
+#include <cstring>
 #include <unordered_map>
+#include <vector>
 
 
 namespace {
 
-constexpr bool DBG = true;
+constexpr bool DBG = false;
 
 const std::set<UT_StringHolder> ATTRIBUTE_BLACKLIST = { PLD_PRIM_CLS_NAME, PLD_RPK, PLD_RULE_FILE,
                                                         PLD_START_RULE, PLD_STYLE, PLD_RANDOM_SEED };
@@ -42,6 +44,64 @@ std::wstring getFullyQualifiedStartRule(const MainAttributes& ma) {
 		return ma.mStyle + L'$' + ma.mStartRule;
 }
 
+// primitive attribute with a handle pre-bound according to its storage class
+struct PrimitiveAttribute {
+	UT_StringHolder name;
+	GA_StorageClass storageClass;
+	GA_ROHandleD    floatHandle;
+	GA_ROHandleS    stringHandle;
+	GA_ROHandleI    intHandle;
+};
+using PrimitiveAttributes = std::vector<PrimitiveAttribute>;
+
+PrimitiveAttributes bindPrimitiveAttributes(const std::unordered_map<UT_StringHolder, GA_ROAttributeRef>& attributes) {
+	PrimitiveAttributes primitiveAttributes;
+	primitiveAttributes.reserve(attributes.size());
+	for (const auto& attr: attributes) {
+		const GA_ROAttributeRef& ar = attr.second;
+		if (ar.isInvalid())
+			continue;
+
+		PrimitiveAttribute pa;
+		pa.name = attr.first;
+		pa.storageClass = ar.getStorageClass();
+		switch (pa.storageClass) {
+			case GA_STORECLASS_FLOAT:  pa.floatHandle.bind(ar.get());  if (!pa.floatHandle.isValid())  continue; break;
+			case GA_STORECLASS_STRING: pa.stringHandle.bind(ar.get()); if (!pa.stringHandle.isValid()) continue; break;
+			case GA_STORECLASS_INT:    pa.intHandle.bind(ar.get());    if (!pa.intHandle.isValid())    continue; break;
+			default:
+				LOG_WRN << "prim attr " << ar->getName() << ": unsupported storage class";
+				continue;
+		}
+		primitiveAttributes.push_back(std::move(pa));
+	}
+	return primitiveAttributes;
+}
+
+/**
+ * rule attribute names of the primitive attributes (same order), converted once per style
+ */
+class RuleAttributeNames {
+public:
+	explicit RuleAttributeNames(const PrimitiveAttributes& primitiveAttributes) : mPrimitiveAttributes(primitiveAttributes) { }
+
+	const std::vector<std::wstring>& get(const std::wstring& style) {
+		auto it = mNames.find(style);
+		if (it == mNames.end()) {
+			std::vector<std::wstring> names;
+			names.reserve(mPrimitiveAttributes.size());
+			for (const auto& pa: mPrimitiveAttributes)
+				names.push_back(NameConversion::toRuleAttr(style, pa.name));
+			it = mNames.emplace(style, std::move(names)).first;
+		}
+		return it->second;
+	}
+
+private:
+	const PrimitiveAttributes& mPrimitiveAttributes;
+	std::unordered_map<std::wstring, std::vector<std::wstring>> mNames;
+};
+
 } // namespace
 
 
@@ -68,21 +128,16 @@ void ShapeGenerator::get(const GU_Detail* detail, const PrimitiveClassifier& pri
 			attributes.emplace(n, GA_ROAttributeRef(a));
 		}
 
-		// also filter out the actual primitive classifier attribute
-		std::set<UT_StringHolder> removeMe;
-		const GA_Primitive* p;
-		GA_FOR_ALL_PRIMITIVES(detail, p) {
-			PrimitiveClassifier pc;
-			primCls.updateFromPrimitive(pc, detail, p);
-			if (removeMe.emplace(pc.name).second) {
-				auto aIt = attributes.find(pc.name);
-				if (aIt != attributes.end()) {
-					attributes.erase(aIt);
-				}
-			}
-		}
+		// also filter out the actual primitive classifier attributes (as encountered by the partitioning)
+		for (const auto& clsName: shapeData.getClassifierNames())
+			attributes.erase(clsName);
 	}
 
+	const PrimitiveAttributes primitiveAttributes = bindPrimitiveAttributes(attributes);
+	RuleAttributeNames ruleAttributeNames(primitiveAttributes);
+
+	std::wstring wv; // reused conversion buffer for string attribute values
+
 	// loop over all initial shapes and use the first primitive to get the attribute values
 	for (size_t isIdx = 0; isIdx < shapeData.getInitialShapeBuilders().size(); isIdx++) {
 		const auto& pv = shapeData.getPrimitiveMapping(isIdx);
@@ -102,49 +157,35 @@ void ShapeGenerator::get(const GU_Detail* detail, const PrimitiveClassifier& pri
 			continue;
 
 		// extract primitive attributes
+		const std::vector<std::wstring>& ruleAttrNames = ruleAttributeNames.get(ma.mStyle);
 		AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
-		for (const auto& attr: attributes) {
-			const GA_ROAttributeRef& ar = attr.second;
+		for (size_t ai = 0; ai < primitiveAttributes.size(); ai++) {
+			const PrimitiveAttribute& pa = primitiveAttributes[ai];
+			const wchar_t* ruleAttrName = ruleAttrNames[ai].c_str();
 
-			if (ar.isInvalid())
-				continue;
-
-			const std::wstring ruleAttrName = NameConversion::toRuleAttr(ma.mStyle, attr.first);
-
-			switch (ar.getStorageClass()) {
+			switch (pa.storageClass) {
 				case GA_STORECLASS_FLOAT: {
-					GA_ROHandleD av(ar);
-					if (av.isValid()) {
-						double v = av.get(primitiveMapOffset);
-						if (DBG) LOG_DBG << "   prim float attr: " << ar->getName() << " = " << v;
-						amb->setFloat(ruleAttrName.c_str(), v);
-					}
+					const double v = pa.floatHandle.get(primitiveMapOffset);
+					if (DBG) LOG_DBG << "   prim float attr: " << pa.name << " = " << v;
+					amb->setFloat(ruleAttrName, v);
 					break;
 				}
 				case GA_STORECLASS_STRING: {
-					GA_ROHandleS av(ar);
-					if (av.isValid()) {
-						const char* v = av.get(primitiveMapOffset);
-						const std::wstring wv = toUTF16FromOSNarrow(v);
-						if (DBG) LOG_DBG << "   prim string attr: " << ar->getName() << " = " << v;
-						amb->setString(ruleAttrName.c_str(), wv.c_str());
-					}
+					const char* v = pa.stringHandle.get(primitiveMapOffset);
+					toUTF16FromOSNarrow(v, (v != nullptr) ? std::strlen(v) : 0, wv);
+					if (DBG) LOG_DBG << "   prim string attr: " << pa.name << " = " << v;
+					amb->setString(ruleAttrName, wv.c_str());
 					break;
 				}
 				case GA_STORECLASS_INT: {
-					GA_ROHandleI av(ar);
-					if (av.isValid()) {
-						const int v = av.get(primitiveMapOffset);
-						const bool bv = (v > 0);
-						if (DBG) LOG_DBG << "   prim bool attr: " << ar->getName() << " = " << v;
-						amb->setBool(ruleAttrName.c_str(), bv);
-					}
-					break;
-				}
-				default: {
-					LOG_WRN << "prim attr " << ar->getName() << ": unsupported storage class";
+					const int v = pa.intHandle.get(primitiveMapOffset);
+					const bool bv = (v > 0);
+					if (DBG) LOG_DBG << "   prim bool attr: " << pa.name << " = " << v;
+					amb->setBool(ruleAttrName, bv);
 					break;
 				}
+				default:
+					break; // filtered out by bindPrimitiveAttributes
 			} // switch key type
 		} // for each primitive attribute
 
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Tracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+constexpr size_t RING_SIZE = 1 << 16; // events per thread (2MB), must be a power of two. older events are overwritten
+
+struct TraceEvent {
+	const char* name;
+	const char* function;
+	uint64_t    start;
+	uint64_t    end;
+};
+
+// ring buffer written by the owning thread only, the export reads the events recorded since its previous call
+struct ThreadBuffer {
+	explicit ThreadBuffer(uint32_t id) : tid(id), events(new TraceEvent[RING_SIZE]) { }
+
+	const uint32_t                tid;
+	std::unique_ptr<TraceEvent[]> events;
+	std::atomic<uint64_t>         written{0};
+
+	// export state, guarded by registryMutex
+	uint64_t                      exported = 0;
+	bool                          named    = false;
+};
+
+std::atomic<bool> enabled(false);
+const auto epoch = std::chrono::steady_clock::now();
+
+// buffers are kept until process exit, threads might end before the export. the buffer of an exited thread is reused
+// by the next new thread, i.e. the number of buffers is bounded by the maximum number of concurrent threads (e.g. the
+// generate threads started for each cook).
+std::mutex                                 registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+std::vector<ThreadBuffer*>                 freeBuffers;
+
+// hands the buffer back to the free list when its thread exits
+struct ThreadBufferOwner {
+	ThreadBuffer* buffer = nullptr;
+
+	~ThreadBufferOwner() {
+		if (buffer != nullptr) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			freeBuffers.push_back(buffer);
+		}
+	}
+};
+thread_local ThreadBufferOwner threadBufferOwner;
+
+ThreadBuffer* getThreadBuffer() {
+	if (threadBufferOwner.buffer == nullptr) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (!freeBuffers.empty()) {
+			threadBufferOwner.buffer = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+		else {
+			registry.emplace_back(new ThreadBuffer(static_cast<uint32_t>(registry.size() + 1)));
+			threadBufferOwner.buffer = registry.back().get();
+		}
+	}
+	return threadBufferOwner.buffer;
+}
+
+// index of the oldest event which is still in the ring buffer
+uint64_t getOldest(uint64_t written) {
+	return (written > RING_SIZE) ? written - RING_SIZE : 0;
+}
+
+// e.g. "void ShapeGenerator::get(const GU_Detail*, ...)" -> "ShapeGenerator::get"
+std::string stripArgs(const std::string& s) {
+	std::string t = s.substr(0, s.find_first_of('('));
+	auto p = t.find_last_of(' ');
+	return (p != std::string::npos) ? t.substr(p+1) : t;
+}
+
+std::string escapeJSON(const std::string& s) {
+	std::string e;
+	e.reserve(s.size());
+	for (const char c: s) {
+		if (c == '"' || c == '\\')
+			e.push_back('\\');
+		if (static_cast<unsigned char>(c) >= 0x20)
+			e.push_back(c);
+	}
+	return e;
+}
+
+} // namespace
+
+
+namespace tracing {
+
+bool isEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool e) {
+	enabled.store(e, std::memory_order_relaxed);
+}
+
+uint64_t now() {
+	const auto d = std::chrono::steady_clock::now() - epoch;
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()) + 1; // 0 means "not started"
+}
+
+void record(const char* name, const char* function, uint64_t start, uint64_t end) {
+	ThreadBuffer* b = getThreadBuffer();
+	const uint64_t n = b->written.load(std::memory_order_relaxed);
+	b->events[n & (RING_SIZE - 1)] = { name, function, start, end };
+	b->written.store(n + 1, std::memory_order_release);
+}
+
+void writeChromeTraceEvents(std::ostream& out) {
+	using NameKey = std::pair<const char*, const char*>;
+	struct NameKeyHash {
+		size_t operator()(const NameKey& k) const {
+			return std::hash<const void*>()(k.first) ^ (std::hash<const void*>()(k.second) << 1);
+		}
+	};
+	std::unordered_map<NameKey, std::string, NameKeyHash> names; // assembled once per static string pair
+
+	const auto toMicroseconds = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+	const std::ios::fmtflags oldFlags = out.flags();
+	const std::streamsize oldPrecision = out.precision();
+	out << std::fixed << std::setprecision(3);
+
+	std::vector<TraceEvent> events;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const auto& b: registry) {
+		if (!b->named) {
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+			    << ",\"args\":{\"name\":\"palladio " << b->tid << "\"}},\n";
+			b->named = true;
+		}
+
+		// copy first, then drop the events which the owning thread might have overwritten while we were copying
+		const uint64_t written = b->written.load(std::memory_order_acquire);
+		const uint64_t begin = std::max(b->exported, getOldest(written));
+		events.clear();
+		for (uint64_t i = begin; i < written; i++)
+			events.push_back(b->events[i & (RING_SIZE - 1)]);
+		const uint64_t valid = std::max(begin, getOldest(b->written.load(std::memory_order_acquire) + 1));
+		const uint64_t overwritten = valid - b->exported;
+		b->exported = written;
+
+		for (uint64_t i = valid; i < written; i++) {
+			const TraceEvent& e = events[i - begin];
+			auto it = names.find(NameKey(e.name, e.function));
+			if (it == names.end())
+				it = names.emplace(NameKey(e.name, e.function), escapeJSON(stripArgs(e.function) + ": " + e.name)).first;
+
+			out << "{\"name\":\"" << it->second << "\",\"cat\":\"palladio\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+			    << ",\"ts\":" << toMicroseconds(e.start) << ",\"dur\":" << toMicroseconds(e.end - e.start) << "},\n";
+		}
+
+		if (overwritten > 0 && valid < written) {
+			out << "{\"name\":\"overwrote " << overwritten << " events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << b->tid
+			    << ",\"ts\":" << toMicroseconds(events[valid - begin].start) << "},\n";
+		}
+	}
+
+	out.flags(oldFlags);
+	out.precision(oldPrecision);
+}
+
+} // namespace tracing
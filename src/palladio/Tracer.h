@@ -0,0 +1,81 @@
+/*
+ * Copyright 2014-2019 Esri R&D Zurich and VRBN
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "PalladioMain.h"
+
+#include <cstdint>
+#include <ostream>
+
+
+/**
+ * Scoped trace events, e.g. WA("all") records the duration of the enclosing scope under the name
+ * "<function>: all". Tracing is disabled by default (each scope then costs one flag check) and enabled by setting
+ * PALLADIO_TRACE_FILE, the events recorded since the previous export are appended as Chrome trace (chrome://tracing,
+ * Perfetto) after each cook and on shutdown.
+ *
+ * Events are recorded into per-thread ring buffers without locking (the oldest events are overwritten) and only refer
+ * to static strings (the name literal and the compiler's function name), names are assembled on export.
+ * Do not use WA in functions which run per primitive or per attribute name.
+ */
+#ifdef _WIN32
+#	define PLD_TRACE_FUNCTION __FUNCSIG__
+#else
+#	define PLD_TRACE_FUNCTION __PRETTY_FUNCTION__
+#endif
+
+#define PLD_TRACE_CONCAT_(a, b) a##b
+#define PLD_TRACE_CONCAT(a, b) PLD_TRACE_CONCAT_(a, b)
+
+#define WA(x) tracing::Scope PLD_TRACE_CONCAT(pldTraceScope, __LINE__)(x, PLD_TRACE_FUNCTION)
+
+
+namespace tracing {
+
+PLD_TEST_EXPORTS_API bool isEnabled();
+PLD_TEST_EXPORTS_API void setEnabled(bool enabled);
+
+// nanoseconds since an arbitrary (per process) epoch
+PLD_TEST_EXPORTS_API uint64_t now();
+
+// name and function must be static strings
+PLD_TEST_EXPORTS_API void record(const char* name, const char* function, uint64_t start, uint64_t end);
+
+// writes the events recorded since the previous call as elements of a Chrome trace JSON array, each followed by ",\n".
+// the caller writes the opening "[" once, the closing bracket is optional for the trace viewers.
+PLD_TEST_EXPORTS_API void writeChromeTraceEvents(std::ostream& out);
+
+class Scope {
+public:
+	Scope(const char* name, const char* function) : mName(name), mFunction(function), mStart(isEnabled() ? now() : 0) { }
+
+	~Scope() {
+		if (mStart != 0)
+			record(mName, mFunction, mStart, now());
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+private:
+	const char*    mName;
+	const char*    mFunction;
+	const uint64_t mStart;
+};
+
+} // namespace tracing
@@ -38,6 +38,11 @@
 #	include <dlfcn.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define PLD_HAVE_SSE2
+#	include <emmintrin.h>
+#endif
+
 
 void getCGBs(const ResolveMapSPtr& rm, std::vector<std::pair<std::wstring,std::wstring>>& cgbs) {
 	constexpr const wchar_t* PROJECT    = L"";
@@ -146,41 +151,150 @@ std::string getSharedLibrarySuffix() {
 #endif
 }
 
-std::string toOSNarrowFromUTF16(const std::wstring& osWString) {
-	std::vector<char> temp(osWString.size());
-	size_t size = temp.size();
+namespace {
+
+// scratch buffers for the prt::StringUtils fallback, grow to the largest converted string per thread
+thread_local std::vector<char>    narrowBuffer;
+thread_local std::vector<wchar_t> wideBuffer;
+
+// calls a prt::StringUtils conversion function, retries once with the required buffer size
+template<typename S, typename D, typename F>
+const D* convertWithPRT(const S* src, std::vector<D>& buffer, size_t minSize, F convert) {
+	if (buffer.size() < minSize)
+		buffer.resize(minSize);
+	size_t size = buffer.size();
 	prt::Status status = prt::STATUS_OK;
-	prt::StringUtils::toOSNarrowFromUTF16(osWString.c_str(), temp.data(), &size, &status);
-	if(size > temp.size()) {
-		temp.resize(size);
-		prt::StringUtils::toOSNarrowFromUTF16(osWString.c_str(), temp.data(), &size, &status);
+	convert(src, buffer.data(), &size, &status);
+	if (size > buffer.size()) {
+		buffer.resize(size);
+		size = buffer.size();
+		convert(src, buffer.data(), &size, &status);
+	}
+	if (status != prt::STATUS_OK) {
+		LOG_DBG << "string conversion failed: " << prt::getStatusDescription(status);
+		return nullptr;
 	}
-	return std::string(temp.data());
+	return buffer.data();
 }
 
-std::wstring toUTF16FromOSNarrow(const std::string& osString) {
-	std::vector<wchar_t> temp(osString.size());
-	size_t size = temp.size();
-	prt::Status status = prt::STATUS_OK;
-	prt::StringUtils::toUTF16FromOSNarrow(osString.c_str(), temp.data(), &size, &status);
-	if(size > temp.size()) {
-		temp.resize(size);
-		prt::StringUtils::toUTF16FromOSNarrow(osString.c_str(), temp.data(), &size, &status);
+} // namespace
+
+
+bool isASCII(const char* s, size_t length) {
+	size_t i = 0;
+#ifdef PLD_HAVE_SSE2
+	for (; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		if (_mm_movemask_epi8(v) != 0) // any high bit set
+			return false;
 	}
-	return std::wstring(temp.data());
+#endif
+	for (; i < length; i++) {
+		if (static_cast<unsigned char>(s[i]) > 0x7F)
+			return false;
+	}
+	return true;
 }
 
-std::string toUTF8FromOSNarrow(const std::string& osString) {
-	std::wstring utf16String = toUTF16FromOSNarrow(osString);
-	std::vector<char> temp(utf16String.size());
-	size_t size = temp.size();
-	prt::Status status = prt::STATUS_OK;
-	prt::StringUtils::toUTF8FromUTF16(utf16String.c_str(), temp.data(), &size, &status);
-	if(size > temp.size()) {
-		temp.resize(size);
-		prt::StringUtils::toUTF8FromUTF16(utf16String.c_str(), temp.data(), &size, &status);
+bool isASCII(const wchar_t* s, size_t length) {
+	size_t i = 0;
+#ifdef PLD_HAVE_SSE2
+	constexpr size_t STEP = sizeof(__m128i) / sizeof(wchar_t);
+	const __m128i nonASCII = (sizeof(wchar_t) == 2) ? _mm_set1_epi16(static_cast<short>(0xFF80))
+	                                                : _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + STEP <= length; i += STEP) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, nonASCII), zero)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for (; i < length; i++) {
+		if (static_cast<uint32_t>(s[i]) > 0x7F)
+			return false;
+	}
+	return true;
+}
+
+void toOSNarrowFromUTF16(const wchar_t* osWString, size_t length, std::string& osString) {
+	if (isASCII(osWString, length)) {
+		osString.resize(length);
+		for (size_t i = 0; i < length; i++)
+			osString[i] = static_cast<char>(osWString[i]);
+		return;
 	}
-	return std::string(temp.data());
+
+	const std::wstring src(osWString, length); // prt::StringUtils expects zero termination
+	const char* dst = convertWithPRT(src.c_str(), narrowBuffer, 3 * length + 1, prt::StringUtils::toOSNarrowFromUTF16);
+	if (dst != nullptr)
+		osString.assign(dst);
+	else
+		osString.clear();
+}
+
+void toUTF16FromOSNarrow(const char* osString, size_t length, std::wstring& osWString) {
+	if (isASCII(osString, length)) {
+		osWString.resize(length);
+		for (size_t i = 0; i < length; i++)
+			osWString[i] = static_cast<wchar_t>(osString[i]);
+		return;
+	}
+
+	const std::string src(osString, length);
+	const wchar_t* dst = convertWithPRT(src.c_str(), wideBuffer, length + 1, prt::StringUtils::toUTF16FromOSNarrow);
+	if (dst != nullptr)
+		osWString.assign(dst);
+	else
+		osWString.clear();
+}
+
+void toUTF8FromOSNarrow(const char* osString, size_t length, std::string& utf8String) {
+	if (isASCII(osString, length)) { // ASCII is a subset of both encodings
+		utf8String.assign(osString, length);
+		return;
+	}
+
+	std::wstring utf16String;
+	toUTF16FromOSNarrow(osString, length, utf16String);
+	const char* dst = convertWithPRT(utf16String.c_str(), narrowBuffer, 3 * utf16String.size() + 1, prt::StringUtils::toUTF8FromUTF16);
+	if (dst != nullptr)
+		utf8String.assign(dst);
+	else
+		utf8String.clear();
+}
+
+std::string toOSNarrowFromUTF16(const std::wstring& osWString) {
+	std::string s;
+	toOSNarrowFromUTF16(osWString.c_str(), osWString.size(), s);
+	return s;
+}
+
+std::wstring toUTF16FromOSNarrow(const std::string& osString) {
+	std::wstring s;
+	toUTF16FromOSNarrow(osString.c_str(), osString.size(), s);
+	return s;
+}
+
+std::string toUTF8FromOSNarrow(const std::string& osString) {
+	std::string s;
+	toUTF8FromOSNarrow(osString.c_str(), osString.size(), s);
+	return s;
+}
+
+std::string toUTF8FromUTF16(const std::wstring& utf16String) {
+	if (isASCII(utf16String.c_str(), utf16String.size()))
+		return std::string(utf16String.begin(), utf16String.end());
+
+	const char* dst = convertWithPRT(utf16String.c_str(), narrowBuffer, 3 * utf16String.size() + 1, prt::StringUtils::toUTF8FromUTF16);
+	return (dst != nullptr) ? std::string(dst) : std::string();
+}
+
+std::wstring toUTF16FromUTF8(const std::string& utf8String) {
+	if (isASCII(utf8String.c_str(), utf8String.size()))
+		return std::wstring(utf8String.begin(), utf8String.end());
+
+	const wchar_t* dst = convertWithPRT(utf8String.c_str(), wideBuffer, utf8String.size() + 1, prt::StringUtils::toUTF16FromUTF8);
+	return (dst != nullptr) ? std::wstring(dst) : std::wstring();
 }
 
 std::wstring toFileURI(const PLD_BOOST_NS::filesystem::path& p) {
@@ -28,8 +28,10 @@
 
 #include "GA/GA_Primitive.h"
 
+#include <cwchar>
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 
@@ -44,6 +46,7 @@ struct PRTDestroyer {
 using PrimitiveNOPtrVector      = std::vector<const GA_Primitive*>;
 
 using ObjectUPtr                = std::unique_ptr<const prt::Object, PRTDestroyer>;
+using InitialShapeUPtr          = std::unique_ptr<const prt::InitialShape, PRTDestroyer>;
 using InitialShapeNOPtrVector   = std::vector<const prt::InitialShape*>;
 using AttributeMapNOPtrVector   = std::vector<const prt::AttributeMap*>;
 using CacheObjectUPtr           = std::unique_ptr<prt::CacheObject, PRTDestroyer>;
@@ -68,9 +71,20 @@ void getLibraryPath(PLD_BOOST_NS::filesystem::path& path, const void* func);
 std::string getSharedLibraryPrefix();
 std::string getSharedLibrarySuffix();
 
+PLD_TEST_EXPORTS_API bool isASCII(const char* s, size_t length);
+PLD_TEST_EXPORTS_API bool isASCII(const wchar_t* s, size_t length);
+
+// pure ASCII strings are converted directly, everything else goes through prt::StringUtils
+// the overloads with an output argument reuse its capacity and do not allocate in the common case
+PLD_TEST_EXPORTS_API void toOSNarrowFromUTF16(const wchar_t* osWString, size_t length, std::string& osString);
+PLD_TEST_EXPORTS_API void toUTF16FromOSNarrow(const char* osString, size_t length, std::wstring& osWString);
+PLD_TEST_EXPORTS_API void toUTF8FromOSNarrow(const char* osString, size_t length, std::string& utf8String);
+
 PLD_TEST_EXPORTS_API std::string toOSNarrowFromUTF16(const std::wstring& osWString);
-std::wstring toUTF16FromOSNarrow(const std::string& osString);
-std::string toUTF8FromOSNarrow(const std::string& osString);
+PLD_TEST_EXPORTS_API std::wstring toUTF16FromOSNarrow(const std::string& osString);
+PLD_TEST_EXPORTS_API std::string toUTF8FromOSNarrow(const std::string& osString);
+PLD_TEST_EXPORTS_API std::string toUTF8FromUTF16(const std::wstring& utf16String);
+PLD_TEST_EXPORTS_API std::wstring toUTF16FromUTF8(const std::string& utf8String);
 
 PLD_TEST_EXPORTS_API std::wstring toFileURI(const PLD_BOOST_NS::filesystem::path& p);
 PLD_TEST_EXPORTS_API std::wstring percentEncode(const std::string& utf8String);
@@ -85,6 +99,28 @@ inline void replace_all_not_of(std::wstring& s, const std::wstring& allowedChars
 	}
 }
 
+// hash and equality of zero-terminated wide strings, for hashed containers of (non-owned) string pointers
+struct WCharPtrHash {
+	size_t operator()(const wchar_t* s) const {
+		// FNV-1a
+		size_t h = (sizeof(size_t) == 8) ? static_cast<size_t>(14695981039346656037ULL) : 2166136261U;
+		const size_t prime = (sizeof(size_t) == 8) ? static_cast<size_t>(1099511628211ULL) : 16777619U;
+		for (; *s != L'\0'; ++s) {
+			h ^= static_cast<size_t>(*s);
+			h *= prime;
+		}
+		return h;
+	}
+};
+
+struct WCharPtrEqual {
+	bool operator()(const wchar_t* a, const wchar_t* b) const {
+		return std::wcscmp(a, b) == 0;
+	}
+};
+
+using WCharPtrSet = std::unordered_set<const wchar_t*, WCharPtrHash, WCharPtrEqual>;
+
 inline bool startsWithAnyOf(const std::string& s, const std::vector<std::string>& sv) {
 	for (const auto& v: sv) {
 		if (s.find(v) == 0)
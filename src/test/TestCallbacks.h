@@ -42,6 +42,10 @@ struct CallbackResult {
 	std::vector<AttributeMapUPtr> materials;
 	std::map<int32_t, AttributeMapUPtr> attrsPerShapeID;
 
+	uint32_t leafShapeCount = 0;
+	uint32_t faceCount = 0;
+	size_t geometryBytes = 0;
+
 	explicit CallbackResult(size_t uvSets) : uvs(uvSets), uvCounts(uvSets), uvIndices(uvSets) { }
 };
 
@@ -50,6 +54,11 @@ public:
 	std::vector<CallbackResult> results;
 	std::map<int32_t, AttributeMapBuilderUPtr> attrs;
 
+	// values of the last addStatistics call, consumed by the next add call
+	uint32_t pendingLeafShapeCount = 0;
+	uint32_t pendingFaceCount = 0;
+	size_t pendingGeometryBytes = 0;
+
 	void add(const wchar_t* name,
 			 const double* vtx, size_t vtxSize,
 			 const double* nrm, size_t nrmSize,
@@ -67,6 +76,13 @@ public:
 		results.emplace_back(CallbackResult(uvSets));
 		auto& cr = results.back();
 
+		cr.leafShapeCount = pendingLeafShapeCount;
+		cr.faceCount = pendingFaceCount;
+		cr.geometryBytes = pendingGeometryBytes;
+		pendingLeafShapeCount = 0;
+		pendingFaceCount = 0;
+		pendingGeometryBytes = 0;
+
 		cr.name = name;
 		cr.vtx.assign(vtx, vtx+vtxSize);
 		cr.nrm.assign(nrm, nrm+nrmSize);
@@ -93,6 +109,13 @@ public:
 		attrs.clear();
 	}
 
+	void addStatistics(size_t isIndex, uint32_t leafShapeCount, uint32_t faceCount, size_t geometryBytes,
+	                   double encodeTime) override {
+		pendingLeafShapeCount = leafShapeCount;
+		pendingFaceCount = faceCount;
+		pendingGeometryBytes = geometryBytes;
+	}
+
 	prt::Status generateError(size_t isIndex, prt::Status status, const wchar_t* message) override {
 		return prt::STATUS_OK;
 	}
@@ -86,6 +86,7 @@ void generate(TestCallbacks& tc,
 	amb->setBool(L"emitAttributes", true);
 	amb->setBool(L"emitMaterials", true);
 	amb->setBool(L"emitReports", true);
+	amb->setBool(L"emitStatistics", true);
 	const AttributeMapUPtr rawEncOpts(amb->createAttributeMapAndReset());
 	const AttributeMapUPtr houdiniEncOpts(createValidatedOptions(ENCODER_ID_HOUDINI, rawEncOpts.get()));
 
@@ -21,6 +21,11 @@
 #include "../palladio/Utils.h"
 #include "../palladio/ModelConverter.h"
 #include "../palladio/AttributeConversion.h"
+#include "../palladio/DefaultAttributeCache.h"
+#include "../palladio/SOPAssign.h"
+#include "../palladio/RPKStore.h"
+#include "../palladio/LRUCache.h"
+#include "../palladio/Tracer.h"
 #include "../codec/encoder/HoudiniEncoder.h"
 
 #include "prt/AttributeMap.h"
@@ -29,11 +34,13 @@
 
 #include "../palladio/BoostRedirect.h"
 #include PLD_BOOST_INCLUDE(/filesystem/path.hpp)
+#include PLD_BOOST_INCLUDE(/filesystem/operations.hpp)
 
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
 
 #include <algorithm>
+#include <sstream>
 
 
 namespace {
@@ -77,6 +84,43 @@ TEST_CASE("create file URI from path", "[utils]" ) {
 #endif
 }
 
+TEST_CASE("detect ASCII strings", "[utils]") {
+	const std::string a(40, 'a');
+	const std::wstring w(40, L'a');
+	CHECK(isASCII(a.c_str(), a.size()));
+	CHECK(isASCII(w.c_str(), w.size()));
+
+	for (size_t p: { 0, 15, 16, 39 }) { // positions in and after the SIMD blocks
+		std::string na = a;
+		na[p] = static_cast<char>(0xC3);
+		CHECK_FALSE(isASCII(na.c_str(), na.size()));
+
+		std::wstring nw = w;
+		nw[p] = L'\u00E4';
+		CHECK_FALSE(isASCII(nw.c_str(), nw.size()));
+		nw[p] = L'\u0100';
+		CHECK_FALSE(isASCII(nw.c_str(), nw.size()));
+	}
+}
+
+TEST_CASE("convert between narrow and wide strings", "[utils]") {
+	const std::wstring w = L"foo.bar/1234567890_abcdefghijklmnopqrstuvwxyz";
+	CHECK(toOSNarrowFromUTF16(w) == "foo.bar/1234567890_abcdefghijklmnopqrstuvwxyz");
+	CHECK(toUTF16FromOSNarrow(toOSNarrowFromUTF16(w)) == w);
+	CHECK(toUTF8FromOSNarrow("foo bar") == "foo bar");
+
+	std::string s = "some longer previous content";
+	toOSNarrowFromUTF16(w.c_str(), 3, s);
+	CHECK(s == "foo");
+}
+
+TEST_CASE("convert between UTF-8 and UTF-16", "[utils]") {
+	CHECK(toUTF8FromUTF16(L"foo/bar.cgb") == "foo/bar.cgb");
+	CHECK(toUTF8FromUTF16(L"caf\u00e9") == "caf\xc3\xa9");
+	CHECK(toUTF16FromUTF8("caf\xc3\xa9") == L"caf\u00e9");
+	CHECK(toUTF16FromUTF8(toUTF8FromUTF16(L"\u5317\u4eac")) == L"\u5317\u4eac");
+}
+
 TEST_CASE("percent-encode a UTF-8 string", "[utils]") {
     CHECK(percentEncode("with space") == L"with%20space");
 }
@@ -89,6 +133,259 @@ TEST_CASE("get XML representation of a PRT object", "[utils]") {
     CHECK(xml == "<attributable>\n\t<attribute key=\"foo\" value=\"bar\" type=\"str\"/>\n</attributable>"); // TODO: use R?
 }
 
+TEST_CASE("compare attribute maps", "[DefaultAttributeCache]") {
+	auto createMap = [](double f, const wchar_t* s) {
+		AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+		amb->setFloat(L"height", f);
+		amb->setString(L"name", s);
+		amb->setBool(L"flag", true);
+		return AttributeMapUPtr(amb->createAttributeMap());
+	};
+
+	const AttributeMapUPtr a = createMap(1.0, L"foo");
+
+	SECTION("equal") {
+		const AttributeMapUPtr b = createMap(1.0, L"foo");
+		CHECK(equalAttributeMaps(a.get(), b.get()));
+	}
+
+	SECTION("different values") {
+		CHECK_FALSE(equalAttributeMaps(a.get(), createMap(2.0, L"foo").get()));
+		CHECK_FALSE(equalAttributeMaps(a.get(), createMap(1.0, L"bar").get()));
+	}
+
+	SECTION("different keys") {
+		AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::createFromAttributeMap(a.get()));
+		amb->setInt(L"count", 3);
+		const AttributeMapUPtr c(amb->createAttributeMap());
+		CHECK_FALSE(equalAttributeMaps(a.get(), c.get()));
+		CHECK_FALSE(equalAttributeMaps(c.get(), a.get()));
+	}
+}
+
+TEST_CASE("collect equal attributes", "[DefaultAttributeCache]") {
+	AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+	amb->setFloat(L"height", 1.0);
+	amb->setString(L"name", L"foo");
+	amb->setBool(L"flag", true);
+	const AttributeMapUPtr a(amb->createAttributeMapAndReset());
+
+	amb->setFloat(L"height", 2.0);
+	amb->setString(L"name", L"foo");
+	amb->setInt(L"flag", 1);
+	amb->setInt(L"count", 3);
+	const AttributeMapUPtr b(amb->createAttributeMapAndReset());
+
+	const AttributeMapUPtr e = createEqualAttributeMap(a.get(), b.get());
+	size_t keyCount = 0;
+	e->getKeys(&keyCount);
+	CHECK(keyCount == 1);
+	CHECK(std::wcscmp(e->getString(L"name"), L"foo") == 0);
+
+	CHECK(equalAttributeMaps(createEqualAttributeMap(a.get(), a.get()).get(), a.get()));
+}
+
+TEST_CASE("cache default rule attributes", "[DefaultAttributeCache]") {
+	using AttributeMapSPtr = DefaultAttributeCache::AttributeMapSPtr;
+	using Invariance = DefaultAttributeCache::Invariance;
+
+	auto createMap = [](const wchar_t* s) {
+		AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+		amb->setString(L"name", s);
+		return AttributeMapSPtr(amb->createAttributeMap(), PRTDestroyer());
+	};
+
+	DefaultAttributeCache cache;
+	const DefaultAttributeCache::RuleKey rk1 = { "a.rpk", L"bin/r1.cgb", L"Default", L"Default$Init" };
+	const DefaultAttributeCache::RuleKey rk2 = { "b.rpk", L"bin/r1.cgb", L"Default", L"Default$Init" };
+	const DefaultAttributeCache::ShapeKey sk1 = { rk1, 0, 1234 };
+	const DefaultAttributeCache::ShapeKey sk2 = { rk1, 1, 1234 };
+	const DefaultAttributeCache::ShapeKey sk3 = { rk2, 0, 1234 };
+
+	SECTION("shape entries") {
+		const AttributeMapSPtr m = createMap(L"foo");
+		cache.insert(sk1, m);
+		cache.insert(sk3, m);
+		CHECK(cache.get(sk1) == m);
+		CHECK_FALSE(cache.get(sk2));
+
+		cache.invalidate(rk1.rpk);
+		CHECK_FALSE(cache.get(sk1));
+		CHECK(cache.get(sk3) == m);
+	}
+
+	SECTION("rule entries") {
+		AttributeMapSPtr invariantAttributes;
+		CHECK(cache.getInvariance(rk1, invariantAttributes) == Invariance::UNKNOWN);
+
+		const AttributeMapSPtr m = createMap(L"foo");
+		cache.setInvariance(rk1, Invariance::PARTIALLY_INVARIANT, m);
+		cache.setInvariance(rk2, Invariance::VARIANT, m);
+
+		CHECK(cache.getInvariance(rk1, invariantAttributes) == Invariance::PARTIALLY_INVARIANT);
+		CHECK(invariantAttributes == m);
+		CHECK(cache.getInvariance(rk2, invariantAttributes) == Invariance::VARIANT);
+		CHECK_FALSE(invariantAttributes);
+
+		cache.invalidate(rk1.rpk);
+		CHECK(cache.getInvariance(rk1, invariantAttributes) == Invariance::UNKNOWN);
+		CHECK(cache.getInvariance(rk2, invariantAttributes) == Invariance::VARIANT);
+	}
+}
+
+TEST_CASE("probe default rule attributes for invariance", "[DefaultAttributeCache]") {
+	using Invariance = DefaultAttributeCache::Invariance;
+
+	const MainAttributes ma = { testDataPath / "GenAttrs1.rpk", L"bin/r1.cgb", L"Default", L"Default$Init" };
+	const ResolveMapSPtr resolveMap = prtCtx->getResolveMap(ma.mRPK);
+	REQUIRE(resolveMap);
+	const RuleFileInfoCache::EntrySPtr ruleFileInfo = prtCtx->getRuleFileInfo(ma.mRPK, resolveMap, ma.mRuleFile);
+
+	DefaultAttributeCache::AttributeMapSPtr a, b;
+	const Invariance ia = evaluateInvariance(ma, resolveMap, ruleFileInfo, prtCtx, a);
+	const Invariance ib = evaluateInvariance(ma, resolveMap, ruleFileInfo, prtCtx, b);
+
+	CHECK(ia != Invariance::UNKNOWN);
+	CHECK(ia == ib);
+	if (ia == Invariance::VARIANT) {
+		CHECK_FALSE(a);
+	}
+	else {
+		REQUIRE(a);
+		REQUIRE(b);
+		CHECK(equalAttributeMaps(a.get(), b.get()));
+	}
+}
+
+TEST_CASE("do not cache default rule attributes of a stale resolve map", "[DefaultAttributeCache]") {
+	namespace fs = PLD_BOOST_NS::filesystem;
+	const fs::path rpk = fs::temp_directory_path() / fs::unique_path("pld_test_%%%%%%%%.rpk");
+	fs::copy_file(testDataPath / "GenAttrs1.rpk", rpk);
+
+	const ResolveMapSPtr staleResolveMap = prtCtx->getResolveMap(rpk);
+	REQUIRE(staleResolveMap);
+
+	// simulate an update of the rule package while a cook still uses the stale resolve map
+	fs::last_write_time(rpk, fs::last_write_time(rpk) + 10);
+	prtCtx->mResolveMapCache->requestValidation(rpk);
+	const ResolveMapSPtr resolveMap = prtCtx->getResolveMap(rpk);
+	REQUIRE(resolveMap);
+	CHECK(resolveMap != staleResolveMap);
+
+	DefaultAttributeCache& cache = *prtCtx->mDefaultAttributeCache;
+	const DefaultAttributeCache::ShapeKey key = { { rpk.string(), L"bin/r1.cgb", L"Default", L"Default$Init" }, 0, 1234 };
+	AttributeMapBuilderUPtr amb(prt::AttributeMapBuilder::create());
+	const DefaultAttributeCache::AttributeMapSPtr defaults(amb->createAttributeMap(), PRTDestroyer());
+	auto insert = [&cache, &key, &defaults]() { cache.insert(key, defaults); };
+
+	CHECK_FALSE(prtCtx->runIfCurrent(rpk, staleResolveMap, insert));
+	CHECK_FALSE(cache.get(key));
+
+	CHECK(prtCtx->runIfCurrent(rpk, resolveMap, insert));
+	CHECK(cache.get(key) == defaults);
+
+	PLD_BOOST_NS::system::error_code ec;
+	fs::remove(rpk, ec);
+}
+
+TEST_CASE("hash rule package content", "[RPKStore]") {
+	const auto rpk1 = testDataPath / "GenAttrs1.rpk";
+	const auto rpk2 = testDataPath / "uvsets.rpk";
+
+	const std::string h1 = getContentHash(rpk1);
+	CHECK_FALSE(h1.empty());
+	CHECK(h1 == getContentHash(rpk1));
+	CHECK(h1 != getContentHash(rpk2));
+	CHECK(getContentHash(testDataPath / "does_not_exist.rpk").empty());
+}
+
+TEST_CASE("least recently used cache", "[LRUCache]") {
+	LRUCache<int> cache(2);
+
+	SECTION("lookup with raw keys") {
+		cache.insert(L"foo", 1);
+		const wchar_t* key = L"foo_bar";
+		REQUIRE(cache.get(key, 3) != nullptr);
+		CHECK(*cache.get(key, 3) == 1);
+		CHECK(cache.get(key, 7) == nullptr);
+	}
+
+	SECTION("evict least recently used") {
+		cache.insert(L"a", 1);
+		cache.insert(L"b", 2);
+		CHECK(cache.get(L"a") != nullptr); // b is now least recently used
+		cache.insert(L"c", 3);
+		CHECK(cache.size() == 2);
+		CHECK(cache.get(L"b") == nullptr);
+		REQUIRE(cache.get(L"a") != nullptr);
+		CHECK(*cache.get(L"a") == 1);
+		REQUIRE(cache.get(L"c") != nullptr);
+		CHECK(*cache.get(L"c") == 3);
+	}
+
+	SECTION("insert does not overwrite") {
+		cache.insert(L"a", 1);
+		CHECK(cache.insert(L"a", 2) == 1);
+		CHECK(*cache.get(L"a") == 1);
+	}
+
+	SECTION("clear") {
+		cache.insert(L"a", 1);
+		cache.clear();
+		CHECK(cache.empty());
+		CHECK(cache.get(L"a") == nullptr);
+	}
+}
+
+TEST_CASE("record trace events", "[tracing]") {
+	const auto traceScope = [](const char* name) { WA(name); };
+
+	traceScope("disabled");
+	tracing::setEnabled(true);
+	traceScope("enabled");
+	tracing::setEnabled(false);
+
+	std::ostringstream out;
+	tracing::writeChromeTraceEvents(out);
+	const std::string trace = out.str();
+	CHECK(trace.find(": enabled\"") != std::string::npos);
+	CHECK(trace.find(": disabled\"") == std::string::npos);
+
+	// the next export only appends new events
+	std::ostringstream next;
+	tracing::writeChromeTraceEvents(next);
+	CHECK(next.str().find(": enabled\"") == std::string::npos);
+}
+
+TEST_CASE("sharded least recently used cache", "[LRUCache]") {
+	ShardedLRUCache<int> cache(64, 4);
+	CHECK(cache.getShardCount() == 4);
+
+	int v = 0;
+	CHECK_FALSE(cache.get(L"a", 1, v));
+	CHECK(cache.insert(L"a", 1, 1) == 1);
+	CHECK(cache.insert(L"a", 1, 2) == 1);
+	REQUIRE(cache.get(L"a", 1, v));
+	CHECK(v == 1);
+
+	for (int i = 0; i < 1000; i++) {
+		const std::wstring k = std::to_wstring(i);
+		cache.insert(k.c_str(), k.size(), int(i));
+	}
+
+	const ShardedLRUCache<int>::Stats stats = cache.getStats();
+	CHECK(stats.hits == 1);
+	CHECK(stats.misses == 1);
+	CHECK(stats.capacity == 64);
+	CHECK(stats.size <= stats.capacity);
+	CHECK(stats.evictions == 1001 - stats.size);
+}
+
+TEST_CASE("convert rule attribute names", "[NameConversion]") {
+	CHECK(NameConversion::toPrimAttr(L"Default$a.b") == UT_StringHolder("a__b"));
+	CHECK(NameConversion::toPrimAttr(L"Default$a.b") == UT_StringHolder("a__b")); // cached
+}
+
 TEST_CASE("replace chars not in set", "[utils]") {
 	const std::wstring ac = L"abc";
 
@@ -588,6 +885,10 @@ TEST_CASE("generate two cubes with two uv sets") {
 
 		const std::vector<uint32_t> faceRangesExp = { 0, 6 };
 		CHECK(cr.faceRanges == faceRangesExp);
+
+		CHECK(cr.faceCount == 6);
+		CHECK(cr.leafShapeCount > 0);
+		CHECK(cr.geometryBytes >= (cr.vtx.size() + cr.nrm.size()) * sizeof(double));
 	}
 
 	{